@@ -1,15 +1,20 @@
 /* This allocator implements a segregated free list to
  * manage all the free blocks based on size classes. 
- * Each index in the hash table represents the size of
- * the block as a power of 2 with a max size of HASH_SIZE.
+ * Each power of 2 is split into SIZE_CLASS_SUBBINS equal
+ * sub-ranges, each with its own index in the hash table, up
+ * to 2^SIZE_CLASS_MAX_LOG2. The last index holds every
+ * block larger than that. Sizes too small to fill every
+ * sub-range get an index per size instead.
  * 
- * Allocated blocks contain an 8 byte header and footer a
- * minimum of 16 bytes for the payload. The lowest
- * bit of the header indicates whether the block 
+ * Allocated blocks contain an 8 byte header and a
+ * minimum of 24 bytes for the payload, with no footer. The
+ * lowest bit of the header indicates whether the block 
  * is allocated (1) or free (0). In this case, 
- * the bit is set to 1. The most significant 58 bits
- * are used for the size since each block is 
- * a multiple of 8.
+ * the bit is set to 1. The second lowest bit records
+ * whether the previous block is allocated, which is all
+ * coalescing needs to know about it. The most significant
+ * 60 bits are used for the size since each block is 
+ * a multiple of 16.
  *
  * Freed blocks contain an 8 byte header and 8 byte 
  * footer which contain the size and the allocated bit
@@ -19,6 +24,13 @@
  * header. A pointer to the previous block's header is stored
  * in the next word after.
  *
+ * Built with COMPACT_HEADERS, headers and footers are 4 byte
+ * size words and the two list links 4 byte distances, in
+ * units of 16 bytes, to the header they point to. The
+ * minimum block shrinks to 16 bytes and an allocated block
+ * carries 4 bytes of overhead, at the price of limiting
+ * every arena heap to COMPACT_HEAP_MAX.
+ *
  * When a block is freed, the allocator bit is set to 0 and
  * goes through coalesce process. The block is then 
  * added to the segregated free list. The block is hashed 
@@ -26,26 +38,115 @@
  * the linked list of blocks.
  *
  * When malloc and realloc are called, the hash table is accessed
- * based on the size argument passed in (minimum being 32 bytes).
- * From there the first block is taken from the linked list.
- *
- * Blocks are coalesced when a block is free'd or when
- * an edge case is encountered where the last block of the
- * heap is free and the heap needs to be extended. In this 
- * case, the new block will be composed of the existing free
- * block and a new heap extension with size being the difference
- * between the size argument and the free block available.
+ * based on the size argument passed in, rounded up to a block of
+ * at least 32 bytes, or 16 bytes with COMPACT_HEADERS.
+ * From there a block is taken from the linked list according to
+ * FIT_POLICY: the first one that fits by default, or the best fit,
+ * the first fit in address order, or the best of the first
+ * FIT_GOOD_PROBES that fit. The last bin, which is unbounded, is
+ * additionally indexed by a treap ordered by size and address, so
+ * the best fit among large blocks is found in logarithmic time.
+ *
+ * Blocks are coalesced when a block is free'd, except for
+ * medium blocks up to QUICK_MAX_SIZE: those are parked, still
+ * marked allocated, in exact-size quick lists of their arena
+ * and reused as they are. Once QUICK_CONSOLIDATE_BYTES are
+ * parked, or a request finds no fit, the quick lists are
+ * sorted by address and coalesced in one batch. A free block
+ * that ends up last in the heap is not added to the
+ * segregated list; it becomes the arena's top chunk, which
+ * requests that no free block fits are carved from. The heap
+ * only grows when the top chunk is too small, by a step that
+ * doubles with every extension up to TOP_GROW_MAX. Pages of
+ * the top chunk beyond TOP_TRIM_THRESHOLD are released back
+ * to the OS with madvise when it grows through frees, and so
+ * are the whole pages inside free blocks of at least
+ * TRIM_BLOCK_THRESHOLD bytes. mm_trim releases everything
+ * that is free on demand.
+ *
+ * The heap is split into up to NUM_ARENAS arenas. Each arena has
+ * its own heap region, segregated list, prologue/epilogue and
+ * lock, and blocks only ever coalesce with neighbours in the same
+ * arena. The main arena grows through mem_sbrk; the others carve
+ * their heap out of an ARENA_HEAP_SIZE-aligned mmap reservation
+ * with the arena_t stored at its base, so the owner of any block
+ * is found by masking its address. Threads are bound to arenas
+ * round-robin and move to an idle arena when theirs is contended.
+ * A thread freeing a block of an arena other than its own does
+ * not take that arena's lock: the block goes onto the arena's
+ * lock-free remote-free stack, which the arena drains in sorted
+ * batches the next time an allocation misses its free lists.
+ *
+ * In front of the arenas, every thread keeps a small cache of
+ * recently freed blocks for each small size class (up to
+ * TCACHE_MAX_SIZE). Cached blocks keep their allocated boundary
+ * tags and are chained through their first payload word, so a
+ * cache hit in mm_malloc or mm_free never touches the segregated
+ * list, coalesce or the headers and footers. Blocks only move
+ * between a thread cache and the segregated list in batches of
+ * TCACHE_BATCH, when a cache bin runs dry or overflows.
+ *
+ * Requests of up to SLAB_MAX_SIZE bytes bypass the boundary-tag
+ * heap entirely. They are served from slabs: SLAB_RUN_SIZE runs
+ * carved out of a dedicated mmap region and split into equal
+ * slots with no per-object header or footer. A run header at the
+ * start of each run holds a bitmap of its free slots, and mm_free
+ * recognizes a slab pointer with a single range check against
+ * the slab region. Runs with free slots hang off their arena,
+ * one list per slab class.
+ *
+ * At the other end, requests of MMAP_THRESHOLD bytes or more
+ * get an anonymous mapping of their own, marked by the MMAPPED
+ * header bit. mm_free unmaps them and mm_realloc resizes them
+ * with mremap, so they never fragment an arena heap or hold
+ * its high-water mark up. Building with MMAP_ADAPTIVE lets
+ * the freeing of a mapping raise the threshold past its
+ * size, up to MMAP_THRESHOLD_MAX, so sizes just above the
+ * threshold that are allocated and freed over and over move
+ * to the heap instead of paying for mmap and munmap each
+ * time. It is off by default, as every size it moves to the
+ * heap can hold the heap's high-water mark up again.
+ *
+ * mm_calloc skips clearing memory that is known to be zero:
+ * fresh mappings, and the tail of the top chunk that came
+ * straight from the OS or had its pages released, which each
+ * arena tracks in top_zero.
+ *
+ * mm_memalign, mm_posix_memalign and mm_aligned_alloc return
+ * payloads aligned beyond 16 bytes without wasting the slack:
+ * the block allocated for them is split at the aligned payload
+ * and the fragments on either side are freed again.
+ *
+ * Built with HUGE_PAGES, the allocator lays its memory out for
+ * transparent huge pages: arena heaps grow to HUGE_PAGE_SIZE
+ * boundaries, and they, the slab region and large mappings are
+ * advised MADV_HUGEPAGE, so the hot small size classes and big
+ * blocks sit in huge pages. Trimming then releases whole huge
+ * pages only, so it never splits one.
  */
 
+#define _GNU_SOURCE     /* mremap */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <errno.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef MM_PROFILE
+#include <time.h>
+#endif
 
 #include "mm.h"
+#include "mm_stats.h"
 #include "memlib.h"
 
 /*********************************************************
@@ -53,16 +154,71 @@
  * Function Declarations
  *
  ********************************************************/
-void * coalesce(void *bp);                      //coalesces the block pointed at by bp. Checks all four cases.
-void * extend_heap(size_t size);                //Extends the heap utilizing the free blocks in the segregated list. Keeps current contents.
+typedef struct arena arena_t;
+
+void * coalesce(arena_t * arena, void *bp);             //coalesces the block pointed at by bp. Checks all four cases.
+void * extend_heap(arena_t * arena, size_t size);       //Grows the top chunk to at least size bytes. Keeps current contents.
 void * get_fit(size_t asize);                   //Defines the policy for finding a free block that fits the size argument.
 void   place(void* bp, size_t asize);           //Marks the header and footer of the block as allocated with the size argument. 
 
 static inline size_t    map_size_class(size_t size);                 //Hashes the key and converts it to an index for the segregated free list hash table
-void   insert_free_block(void * free_block);       //Adds the free block to the segregated list
-void   remove_free_block(void * free_block);  //Removes a free block from the segregated list
-bool   is_block_in_seglist(void * block);       //Quick check to see if a block is in the segregated list.
-bool   is_block_in_freelist(void * block);      //Quick check to see if a block is in the free list.
+void   insert_free_block(arena_t * arena, void * free_block);   //Adds the free block to the segregated list
+void   remove_free_block(arena_t * arena, void * free_block);   //Removes a free block from the segregated list
+bool   is_block_in_seglist(arena_t * arena, void * block);      //Quick check to see if a block is in the segregated list.
+bool   is_block_in_freelist(arena_t * arena, void * block);     //Quick check to see if a block is in the free list.
+
+static int       arena_init_heap(arena_t * arena);              //Lays down the prologue and epilogue of an empty arena heap.
+static void *    arena_sbrk(arena_t * arena, size_t incr);      //Grows the heap region of an arena.
+static arena_t * arena_create(void);                            //Reserves and initializes a secondary arena.
+static arena_t * arena_for_block(void * bp);                    //Finds the arena owning a block.
+static arena_t * arena_assign(void);                            //Binds a thread to the next arena round-robin.
+static arena_t * arena_lock_for_thread(void);                   //Locks the calling thread's arena, moving to an idle one under contention.
+
+static void * slab_alloc(arena_t * arena, size_t slab_class);   //Takes a free slot of a slab class. Caller holds the arena lock.
+static void   slab_free(arena_t * arena, void * bp);            //Returns a slot to its run. Caller holds the arena lock.
+
+static void * carve_top(arena_t * arena, size_t asize);         //Splits a block off the front of the top chunk.
+static bool   trim_top(arena_t * arena, size_t pad);            //Releases top chunk pages beyond pad bytes.
+static bool   release_block_pages(void * bp, char * from, char * to);   //Releases the whole pages of a free block within a range.
+static void * malloc_block(arena_t * arena, size_t asize);      //Allocates a block from the segregated list. Caller holds the arena lock.
+static void * malloc_fit(arena_t * arena, size_t asize);        //Allocates a block from the quick lists or segregated list. Caller holds the arena lock.
+static void * malloc_top(arena_t * arena, size_t asize, char ** zero);  //Carves a block off the top chunk. Caller holds the arena lock.
+static void * calloc_block(arena_t * arena, size_t asize, char ** zero);    //malloc_block that reports the known-zero tail. Caller holds the arena lock.
+static void * memalign_block(arena_t * arena, size_t alignment, size_t asize);  //Allocates a block with an aligned payload. Caller holds the arena lock.
+static void * arena_malloc(size_t asize, size_t alignment, char ** zero);   //Allocates from the thread's arena, falling back to the others.
+static void   zero_payload(void * bp, size_t size);             //Clears memory, streaming past the caches for large sizes.
+static void   shrink_block(arena_t * arena, void * bp, size_t asize);   //Frees the tail of an allocated block. Caller holds the arena lock.
+static bool   grow_block(arena_t * arena, void * bp, size_t asize);     //Grows an allocated block in place. Caller holds the arena lock.
+static void   free_block(arena_t * arena, void * bp);           //Frees and coalesces a block into the segregated list. Caller holds the arena lock.
+static void   sort_addresses(void ** ptrs, size_t n);           //Sorts pointers by address without allocating.
+static size_t free_adjacent_run(arena_t * arena, void ** blocks, size_t n);    //Frees a run of adjacent blocks as one. Caller holds the arena lock.
+static void   quick_free(arena_t * arena, void * bp);           //Parks a freed block in a quick list. Caller holds the arena lock.
+static void   quick_consolidate(arena_t * arena);               //Coalesces every block in the quick lists. Caller holds the arena lock.
+static void   remote_free(arena_t * arena, void * bp);          //Pushes a block onto its arena's remote-free stack. Lock-free.
+static void   remote_drain(arena_t * arena);                    //Frees every block on the remote-free stack. Caller holds the arena lock.
+static void   carve_batch(char * bp, size_t asize, size_t count, void ** out);    //Splits an allocated block into a batch of blocks. Caller holds the arena lock.
+static void * tcache_refill(size_t asize);          //Moves a batch of blocks from the segregated list into the thread cache.
+static void * tcache_refill_slab(size_t slab_class);    //Moves a batch of slab slots into the thread cache.
+static void   tcache_flush(size_t index, size_t count); //Moves blocks from a thread cache bin back to the segregated list.
+
+int    mm_trim(size_t pad);                         //Releases free memory to the OS. Not in the lab's mm.h, so declared here.
+int    mm_check_incremental(size_t budget);         //Checks the next budget blocks of the heap. Not in the lab's mm.h either.
+size_t mm_malloc_batch(size_t size, size_t n, void ** out);    //Allocates n blocks of one size in a single pass.
+void * mm_memalign(size_t alignment, size_t size);             //Allocates a block whose payload is aligned to alignment bytes.
+int    mm_posix_memalign(void ** memptr, size_t alignment, size_t size);   //posix_memalign on top of mm_memalign.
+void * mm_aligned_alloc(size_t alignment, size_t size);        //C11 aligned_alloc on top of mm_memalign.
+void * mm_calloc(size_t nmemb, size_t size);                   //Allocates a zeroed array, skipping memory known to be zero.
+size_t mm_usable_size(void * ptr);                             //Payload bytes a block can hold, for malloc_usable_size.
+void   mm_fork_prepare(void);                                  //Takes every allocator lock before fork.
+void   mm_fork_parent(void);                                   //Releases them again in the parent.
+void   mm_fork_child(void);                                    //Resets them in the child.
+void   mm_free_batch(void ** ptrs, size_t n);                  //Frees n blocks, coalescing adjacent ones once.
+void   mm_free_sized(void * bp, size_t size);                  //Frees a block of a known size without reading its header.
+static size_t largest_free_block(arena_t * arena);  //Finds the size of an arena's largest free block.
+
+static void * mmap_alloc(size_t size, size_t alignment);    //Maps a large block of its own.
+static void   mmap_free(void * bp);                     //Unmaps a large block.
+static void * mmap_realloc(void * bp, size_t size);     //Resizes the mapping of a large block.
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -91,42 +247,469 @@ team_t team = {
 #define MAX(x,y) ((x) > (y)?(x) :(y))
 #define MIN(x,y) ((x) <= (y)?(x) :(y))
 
+/* Compressed boundary tags. With COMPACT_HEADERS set, headers and footers are
+ * 32-bit size words and the free list and treap links are 32-bit distances, in
+ * DSIZE units, to the block linked to. A free block then fits in 16 bytes, and
+ * a list walk touches half the bytes. Block sizes must fit a size word, so
+ * every arena heap is limited to COMPACT_HEAP_MAX. */
+#ifndef COMPACT_HEADERS
+#define COMPACT_HEADERS 0
+#endif
+#if COMPACT_HEADERS
+typedef uint32_t    tag_t;
+typedef int32_t     link_t;
+#define COMPACT_HEAP_MAX    (4UL << 30)
+#else
+typedef uintptr_t   tag_t;
+typedef uintptr_t   link_t;
+#endif
+#define TSIZE       sizeof(tag_t)           /* header and footer size (bytes) */
+#define LSIZE       sizeof(link_t)          /* free list and treap link size (bytes) */
+#define TAG_SIZE_MAX ((size_t)(tag_t)~(DSIZE - 1))  /* largest size a header can hold */
+
+/* Smallest block: a header, two list links and a footer, rounded to DSIZE */
+#define MIN_BLOCK   (DSIZE * ((2 * TSIZE + 2 * LSIZE + DSIZE - 1) / DSIZE))
+
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc) ((size) | (alloc))
 
-/* Read and write a word at address p */
-#define GET(p)          (*(uintptr_t *)(p))
-#define PUT(p,val)      (*(uintptr_t *)(p) = (val))
+/* Read and write a header or footer at address p */
+#define GET(p)          (*(tag_t *)(p))
+#define PUT(p,val)      (*(tag_t *)(p) = (val))
+
+/* Read and write a full pointer-sized word at address p */
+#define GET_WORD(p)     (*(uintptr_t *)(p))
+#define PUT_WORD(p,val) (*(uintptr_t *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)     (GET(p) & ~(DSIZE - 1))
 #define GET_ALLOC(p)    (GET(p) & 0x1)
 
+/* Read, set and clear the previous block's allocated bit in the header at p */
+#define PREV_ALLOC          0x2
+#define GET_PREV_ALLOC(p)   (GET(p) & PREV_ALLOC)
+#define SET_PREV_ALLOC(p)   (PUT(p, GET(p) | PREV_ALLOC))
+#define CLEAR_PREV_ALLOC(p) (PUT(p, GET(p) & ~PREV_ALLOC))
+
+/* Header bit mm_check sets on listed free blocks while it runs */
+#define CHECK_MARK          0x8
+
+/* Header bit of a block that has its own mmap rather than living in an arena */
+#define MMAPPED             0x4
+#define IS_MMAPPED(p)       (GET(p) & MMAPPED)
+
+/* Word before the header of an mmapped block, holding the payload's offset into the mapping */
+#define MMAP_OFFSET_PTR(bp) ((char *)(bp) - DSIZE)
+
+/* The mapping length of an mmapped block. A compact header may be too small
+ * for it, so it is kept in a word of its own in front of the offset word, and
+ * the header holds it saturated, which still compares as a large block. */
+#if COMPACT_HEADERS
+#define MMAP_OVERHEAD       (2 * DSIZE)         /* bytes reserved in front of the payload */
+#define MMAP_LENGTH(bp)     GET_WORD((char *)(bp) - DSIZE - WSIZE)
+#define SET_MMAP_HEADER(bp, map_size) \
+    (PUT_WORD((char *)(bp) - DSIZE - WSIZE, map_size), PUT(HDRP(bp), PACK(MIN(map_size, TAG_SIZE_MAX), 1 | MMAPPED)))
+#else
+#define MMAP_OVERHEAD       DSIZE               /* bytes reserved in front of the payload */
+#define MMAP_LENGTH(bp)     GET_SIZE(HDRP(bp))
+#define SET_MMAP_HEADER(bp, map_size) PUT(HDRP(bp), PACK(map_size, 1 | MMAPPED))
+#endif
+
+/* Adjust a request to include the header and alignment reqs. A block
+ * must be able to hold a header, two list pointers and a footer once free. */
+#define ADJUST_SIZE(size) MAX(MIN_BLOCK, DSIZE * (((size) + TSIZE + (DSIZE-1)) / DSIZE))
+
+/* Read and write a link stored at address at in the free block with header p */
+#if COMPACT_HEADERS
+#define GET_LINK(p, at)         get_link((uintptr_t)(p), (at))
+#define PUT_LINK(p, at, val)    put_link((uintptr_t)(p), (at), (uintptr_t)(val))
+#else
+#define GET_LINK(p, at)         GET_WORD(at)
+#define PUT_LINK(p, at, val)    PUT_WORD(at, val)
+#endif
+
 /* Get the next and prev pointer to free block given pointer to header of a free block */
-#define GET_PRED_PTR(p)  (GET((char*)(p)+WSIZE))
-#define GET_SUCC_PTR(p)  (GET((char*)(p)+DSIZE))
+#define GET_PRED_PTR(p)  GET_LINK(p, (char*)(p)+TSIZE)
+#define GET_SUCC_PTR(p)  GET_LINK(p, (char*)(p)+TSIZE+LSIZE)
 
 /* Set the next and prev pointer to free block given pointer to header of a free block */
-#define SET_PRED_PTR(p,val)  (PUT((char*)(p)+WSIZE, val))
-#define SET_SUCC_PTR(p,val)  (PUT((char*)(p)+DSIZE, val))
+#define SET_PRED_PTR(p,val)  PUT_LINK(p, (char*)(p)+TSIZE, val)
+#define SET_SUCC_PTR(p,val)  PUT_LINK(p, (char*)(p)+TSIZE+LSIZE, val)
+
+/* Child links of a block in the large bin's treap, stored after its list links */
+#define TREE_LEFT(p)           ((void *)GET_LINK(p, (char *)(p) + TSIZE + 2 * LSIZE))
+#define TREE_RIGHT(p)          ((void *)GET_LINK(p, (char *)(p) + TSIZE + 3 * LSIZE))
+#define SET_TREE_LEFT(p,val)   PUT_LINK(p, (char *)(p) + TSIZE + 2 * LSIZE, (uintptr_t)(val))
+#define SET_TREE_RIGHT(p,val)  PUT_LINK(p, (char *)(p) + TSIZE + 3 * LSIZE, (uintptr_t)(val))
+#define TREE_PRIORITY(p)       ((uint32_t)(((uintptr_t)(p) * 0x9E3779B97F4A7C15ULL) >> 32))
+
+/* End of the list and treap links of the free block with payload bp */
+#define LINKS_END(bp)          ((char *)(bp) + 4 * LSIZE)
 
 /* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)        ((char *)(bp) - WSIZE)
-#define FTRP(bp)        ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+#define HDRP(bp)        ((char *)(bp) - TSIZE)
+#define FTRP(bp)        ((char *)(bp) + GET_SIZE(HDRP(bp)) - 2 * TSIZE)
+
+/* Given block ptr bp, compute address of next and previous blocks.
+ * PREV_BLKP reads the previous block's footer, so it is only valid when
+ * that block is free. */
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - TSIZE)))
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - 2 * TSIZE)))
+
+#if COMPACT_HEADERS
+/**********************************************************
+ * get_link
+ * Decode a compact link of the block with header p. It
+ * holds the distance to the linked block in DSIZE units,
+ * so it reaches any block of the same arena heap, and 0
+ * stands for NULL, as a block never links to itself.
+ **********************************************************/
+static inline uintptr_t get_link(uintptr_t p, void * at)
+{
+    link_t link = *(link_t *)at;
+    return link ? p + (intptr_t)link * (intptr_t)DSIZE : 0;
+}
+
+static inline void put_link(uintptr_t p, void * at, uintptr_t val)
+{
+    *(link_t *)at = val ? (link_t)(((intptr_t)val - (intptr_t)p) / (intptr_t)DSIZE) : 0;
+}
+#endif
+
+/* Size class tunables. Blocks of at most 2^SIZE_CLASS_MIN_LOG2 bytes share
+ * bin 0, every power of 2 above it is split into SIZE_CLASS_SUBBINS bins and
+ * blocks above 2^SIZE_CLASS_MAX_LOG2 share the last bin. Setting
+ * SIZE_CLASS_SUBBINS_LOG2 to 0 gives plain power-of-2 bins.
+ * Block sizes are multiples of DSIZE, so a power of 2 below
+ * 2^SIZE_CLASS_SPLIT_LOG2 holds fewer sizes than SIZE_CLASS_SUBBINS and would
+ * leave some of its bins empty. Up to there every size gets a bin of its own
+ * instead, the first SIZE_CLASS_EXACT_BINS. */
+#ifndef SIZE_CLASS_SUBBINS_LOG2
+#define SIZE_CLASS_SUBBINS_LOG2 2
+#endif
+#define SIZE_CLASS_SUBBINS      (1UL << SIZE_CLASS_SUBBINS_LOG2)
+#define SIZE_CLASS_MIN_LOG2     5       /* bin 0 holds the blocks up to 2*DSIZE */
+#define SIZE_CLASS_MAX_LOG2     19
+#define SIZE_CLASS_SPLIT_LOG2   MAX(SIZE_CLASS_MIN_LOG2, SIZE_CLASS_SUBBINS_LOG2 + __builtin_ctzl(DSIZE))
+#define SIZE_CLASS_EXACT_BINS   ((1UL << SIZE_CLASS_SPLIT_LOG2) / DSIZE - 1)   /* bin i holds blocks of (i + 2) * DSIZE */
+
+#if SIZE_CLASS_SUBBINS_LOG2 > SIZE_CLASS_MIN_LOG2 - 1
+#error "SIZE_CLASS_SUBBINS_LOG2 splits size classes finer than the block alignment"
+#endif
+
+#define HASH_SIZE (SIZE_CLASS_EXACT_BINS + ((SIZE_CLASS_MAX_LOG2 - SIZE_CLASS_SPLIT_LOG2) << SIZE_CLASS_SUBBINS_LOG2) + 1)
+
+/* The last bin holds every block above 2^SIZE_CLASS_MAX_LOG2. Besides its list
+ * it is indexed by a treap ordered by size, so fits in it are found in O(log n). */
+#define LARGE_BIN (HASH_SIZE - 1)
+
+/* Fit policies for find_fit */
+#define FIT_FIRST       0   /* first block in the bin that fits */
+#define FIT_BEST        1   /* smallest block in the bin that fits */
+#define FIT_ADDRESS     2   /* first fit over bins kept in address order */
+#define FIT_GOOD        3   /* smallest of the first FIT_GOOD_PROBES blocks that fit */
+
+#ifndef FIT_POLICY
+#define FIT_POLICY      FIT_FIRST
+#endif
+#ifndef FIT_GOOD_PROBES
+#define FIT_GOOD_PROBES 4
+#endif
+
+#if FIT_POLICY == FIT_BEST
+#define FIT_PROBES      SIZE_MAX
+#elif FIT_POLICY == FIT_GOOD
+#define FIT_PROBES      FIT_GOOD_PROBES
+#elif FIT_POLICY == FIT_FIRST || FIT_POLICY == FIT_ADDRESS
+#define FIT_PROBES      1
+#else
+#error "FIT_POLICY must be FIT_FIRST, FIT_BEST, FIT_ADDRESS or FIT_GOOD"
+#endif
+
+/* Non-empty bin bitmap, one bit per hash table index */
+#define BINMAP_BITS         (8 * sizeof(unsigned long))
+#define BINMAP_WORDS        ((HASH_SIZE + BINMAP_BITS - 1) / BINMAP_BITS)
+#define BINMAP_WORD(index)  ((index) / BINMAP_BITS)
+#define BINMAP_BIT(index)   (1UL << ((index) % BINMAP_BITS))
+
+/* Slab tunables */
+#define SLAB_MAX_SIZE     48                    /* largest request served from slabs */
+#define SLAB_CLASSES      (SLAB_MAX_SIZE / DSIZE)
+#define SLAB_RUN_SIZE     4096UL                /* size and alignment of a run */
+#define SLAB_REGION_SIZE  (1UL << 30)           /* address space reserved for runs */
+#define SLAB_FREEMAP_WORDS 4                    /* enough bits for the slots of a DSIZE-slot run */
+
+/* Map a request to its slab class and back to the slot size */
+#define SLAB_CLASS(size)          (((size) - 1) / DSIZE)
+#define SLAB_SLOT_SIZE(slab_class) (((slab_class) + 1) * DSIZE)
+
+/* Given a slot pointer, compute the address of its run header */
+#define SLAB_RUN(bp)    ((slab_run_t *)((uintptr_t)(bp) & ~(SLAB_RUN_SIZE - 1)))
+#define SLAB_RUN_HDR    (DSIZE * ((sizeof(slab_run_t) + DSIZE - 1) / DSIZE))
+
+/* Cheap test for a pointer into the slab region */
+#define IS_SLAB_PTR(bp) ((uintptr_t)(bp) - (uintptr_t)slab_base < __atomic_load_n(&slab_size, __ATOMIC_ACQUIRE))
+
+/* Thread cache tunables */
+#define TCACHE_MAX_SIZE   512                           /* largest adjusted block size kept in a thread cache */
+#define TCACHE_BINS       (SLAB_CLASSES + (TCACHE_MAX_SIZE - MIN_BLOCK) / DSIZE + 1)  /* slab classes, then one bin per DSIZE step from MIN_BLOCK to TCACHE_MAX_SIZE */
+#define TCACHE_FILL_COUNT 32                            /* a bin holding this many blocks is flushed */
+#define TCACHE_BATCH      8                             /* blocks moved per refill or flush */
+
+/* Map an adjusted block size to its thread cache bin. Slab classes use the first bins. */
+#define TCACHE_INDEX(asize) (SLAB_CLASSES + ((asize) - MIN_BLOCK) / DSIZE)
+
+/* Read and write the thread cache link stored in a cached block's payload */
+#define TCACHE_NEXT(bp)         ((void *)GET_WORD(bp))
+#define SET_TCACHE_NEXT(bp,val) (PUT_WORD(bp, (uintptr_t)(val)))
+
+/* Deferred coalescing. Arena-level frees of blocks above TCACHE_MAX_SIZE and up
+ * to QUICK_MAX_SIZE are parked, still marked allocated, in exact-size quick
+ * lists and only coalesced in batches. */
+#ifndef DEFERRED_COALESCE
+#define DEFERRED_COALESCE       1
+#endif
+#ifndef QUICK_MAX_SIZE
+#define QUICK_MAX_SIZE          2048
+#endif
+#ifndef QUICK_CONSOLIDATE_BYTES
+#define QUICK_CONSOLIDATE_BYTES (256UL << 10)   /* parked bytes that trigger a consolidation */
+#endif
+#define QUICK_BINS              ((QUICK_MAX_SIZE - TCACHE_MAX_SIZE) / DSIZE)
+#define QUICK_INDEX(asize)      (((asize) - TCACHE_MAX_SIZE) / DSIZE - 1)
+#define IS_QUICK_SIZE(asize)    (DEFERRED_COALESCE && (asize) > TCACHE_MAX_SIZE && (asize) <= QUICK_MAX_SIZE)
+/* Most blocks the quick lists can hold at once */
+#define QUICK_CONSOLIDATE_MAX   ((QUICK_CONSOLIDATE_BYTES + QUICK_MAX_SIZE) / (TCACHE_MAX_SIZE + DSIZE) + 1)
+
+/* Remote frees. Blocks freed by a thread that allocates from another arena
+ * are pushed onto their arena's lock-free stack instead of taking its lock,
+ * and the arena takes them in REMOTE_DRAIN_BATCH at a time on a miss. */
+#ifndef REMOTE_FREE
+#define REMOTE_FREE             1
+#endif
+#ifndef REMOTE_DRAIN_BATCH
+#define REMOTE_DRAIN_BATCH      256
+#endif
+#define REMOTE_PENDING(arena)   (__atomic_load_n(&(arena)->remote_free, __ATOMIC_RELAXED) != NULL)
+
+/* Top chunk tunables */
+#ifndef TOP_GROW_MIN
+#define TOP_GROW_MIN        (64UL << 10)    /* first heap extension of an arena */
+#endif
+#ifndef TOP_GROW_MAX
+#define TOP_GROW_MAX        (16UL << 20)    /* extensions stop doubling here */
+#endif
+#ifndef TOP_TRIM_THRESHOLD
+#define TOP_TRIM_THRESHOLD  (1UL << 20)     /* top chunk bytes kept resident after frees */
+#endif
+#ifndef TRIM_BLOCK_THRESHOLD
+#define TRIM_BLOCK_THRESHOLD (256UL << 10)  /* free blocks from this size up release their pages */
+#endif
+#ifndef TRIM_ADVICE
+#define TRIM_ADVICE         MADV_DONTNEED   /* MADV_FREE releases lazily, under memory pressure */
+#endif
+#ifndef MEM_SBRK_CLEARS
+#define MEM_SBRK_CLEARS     0               /* set if mem_sbrk hands out zeroed memory, like sbrk */
+#endif
+#define TOP_ZERO_NONE       ((char *)UINTPTR_MAX)   /* no part of the top chunk is known to be zero */
+
+/* calloc tunables */
+#ifndef CALLOC_STREAM_THRESHOLD
+#define CALLOC_STREAM_THRESHOLD (1UL << 20) /* clear from this size up with non-temporal stores */
+#endif
+
+/* Large object tunables */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD      (128UL << 10)   /* blocks of at least this size get their own mapping */
+#endif
+#ifndef MMAP_ADAPTIVE
+#define MMAP_ADAPTIVE       0               /* set to let freed mappings raise the threshold */
+#endif
+#ifndef MMAP_THRESHOLD_MAX
+#define MMAP_THRESHOLD_MAX  (1UL << 20)     /* with MMAP_ADAPTIVE, freed mappings raise the threshold up to this size */
+#endif
+
+/* Round an address to the enclosing page boundaries */
+#define PAGE_ALIGN_UP(p)    ((char *)(((uintptr_t)(p) + page_size - 1) & ~(page_size - 1)))
+#define PAGE_ALIGN_DOWN(p)  ((char *)((uintptr_t)(p) & ~(page_size - 1)))
+
+/* Transparent huge pages. With HUGE_PAGES set, arena heaps grow to huge page
+ * boundaries and, like the slab region and large mappings, are advised
+ * MADV_HUGEPAGE, and trimming only ever releases whole huge pages. */
+#ifndef HUGE_PAGES
+#define HUGE_PAGES          0
+#endif
+#ifndef HUGE_PAGE_SIZE
+#define HUGE_PAGE_SIZE      (2UL << 20)
+#endif
+#define HUGE_ALIGN_UP(p)    ((char *)(((uintptr_t)(p) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1)))
+#define HUGE_ALIGN_DOWN(p)  ((char *)((uintptr_t)(p) & ~(HUGE_PAGE_SIZE - 1)))
+#define TRIM_ALIGN_UP(p)    (HUGE_PAGES ? HUGE_ALIGN_UP(p) : PAGE_ALIGN_UP(p))
+#define TRIM_ALIGN_DOWN(p)  (HUGE_PAGES ? HUGE_ALIGN_DOWN(p) : PAGE_ALIGN_DOWN(p))
+
+/* Arena tunables */
+#define NUM_ARENAS        8                 /* main arena plus secondary arenas */
+#define ARENA_HEAP_SIZE   (1UL << 30)       /* address space reserved for a secondary arena, also its alignment */
+
+/* A run of equal slots for one slab class, headed by this struct */
+typedef struct slab_run {
+    struct slab_run * next;         //next run with free slots, or next free run
+    struct slab_run * prev;         //previous run with free slots
+    arena_t *         arena;        //arena whose lock guards the run
+    unsigned int      slot_size;
+    unsigned int      nslots;
+    unsigned int      nfree;
+    unsigned long     freemap[SLAB_FREEMAP_WORDS];  //bit i is set when slot i is free
+} slab_run_t;
+
+/* Counters behind mm_stats. They are only written under the arena lock, so a
+ * relaxed load and store is enough to update them, and mm_stats can read them
+ * from any thread without ever seeing a torn value. */
+typedef struct arena_stats {
+    size_t          free_blocks[HASH_SIZE];
+    size_t          free_bytes[HASH_SIZE];
+    size_t          allocs[HASH_SIZE];  //allocations served from a block of each bin
+    size_t          top_allocs;     //allocations carved from the top chunk
+    size_t          splits;
+    size_t          coalesces[4];   //by coalesce case, 0 for no free neighbour
+    size_t          extend_calls;
+    size_t          extend_bytes;
+} arena_stats_t;
+
+/* A block merged into the one before it stops being a block, so an incremental
+ * check that was going to resume there resumes at the merged block instead */
+#define CHECK_CURSOR_ABSORB(arena, absorbed, into) \
+    do { if ((arena)->check_cursor == (void *)(absorbed)) (arena)->check_cursor = (into); } while (0)
+
+#define STAT_READ(field)    __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STAT_ADD(field, n)  __atomic_store_n(&(field), STAT_READ(field) + (n), __ATOMIC_RELAXED)
+#define STAT_SUB(field, n)  __atomic_store_n(&(field), STAT_READ(field) - (n), __ATOMIC_RELAXED)
 
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
-#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+/* An independent heap: its own region, segregated list and lock */
+struct arena {
+    void *          segList[HASH_SIZE];
+    void *          large_tree;     //treap over the blocks of LARGE_BIN
+    unsigned long   binmap[BINMAP_WORDS];   //bit i is set when segList[i] is non-empty
+    slab_run_t *    slab_runs[SLAB_CLASSES];    //runs with free slots, per slab class
+    void *          quick[QUICK_BINS];  //freed blocks waiting to be coalesced, per size
+    size_t          quick_bytes;    //bytes parked in the quick lists
+    void *          prologue_ptr;   //pointer to the prologue block
+    void *          epilogue_ptr;   //pointer to the epilogue block
+    void *          top;            //the free block before the epilogue, kept out of segList, or NULL
+    size_t          top_grow;       //bytes added by the next heap extension
+    char *          top_clean;      //pages of the top chunk from here up were released to the OS
+    char *          top_zero;       //the top chunk is zero from here up to its footer, or TOP_ZERO_NONE
+    char *          brk;            //end of the heap region (secondary arenas only)
+    char *          limit;          //end of the reserved region (secondary arenas only)
+    arena_stats_t   stats;
+    void *          check_cursor;   //block mm_check_incremental resumes at, NULL to start over
+    pthread_mutex_t lock;           //serializes every access to this arena but remote_free
+    void *          remote_free __attribute__((aligned(64)));  //blocks freed by other threads, pushed without the lock
+};
+
+/* The main arena grows through mem_sbrk, arenas[1..] through arena_sbrk */
+static arena_t   main_arena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static arena_t * arenas[NUM_ARENAS] = { &main_arena };
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int    next_arena = 0;
+
+/* The slab region, shared by every arena. Runs are bump allocated from
+ * slab_brk and recycled through slab_free_runs. */
+static char *          slab_base = NULL;
+static size_t          slab_size = 0;       //0 until the region is reserved
+static char *          slab_brk = NULL;
+static slab_run_t *    slab_free_runs = NULL;
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t page_size;
+
+/* Smallest adjusted size served by mmap_alloc, raised by mmap_free with MMAP_ADAPTIVE */
+static size_t mmap_threshold = MMAP_THRESHOLD;
+
+/* Arena mm_check_incremental looks at next */
+static size_t check_next_arena = 0;
+
+/* Live mmapped blocks and their mapped bytes, for mm_stats */
+static size_t mmap_blocks = 0;
+static size_t mmap_bytes = 0;
+
+/* Bytes of slab runs handed out of the slab region, for mm_footprint */
+static size_t slab_bytes = 0;
+
+/* Profiling mode. Building with -DMM_PROFILE records a latency histogram in
+ * cycle-counter ticks for each PROFILE_SCOPE, plus the number of free list and
+ * treap nodes each find_fit visits. Without it the macros expand to nothing. */
+#ifdef MM_PROFILE
+
+enum profile_event
+{
+    PROF_MALLOC,
+    PROF_FREE,
+    PROF_REALLOC,
+    PROF_FIND_FIT,
+    PROF_COALESCE,
+    PROF_EXTEND_HEAP,
+    PROF_FIND_FIT_NODES,    //not a latency, nodes visited per find_fit
+    PROF_EVENTS
+};
+
+/* Log-linear buckets: values below 4 get a bucket each, every power of two
+ * above is split into 4 equal sub-buckets */
+#define PROF_SUB_LOG2       2
+#define PROF_BUCKETS        ((64 - PROF_SUB_LOG2 + 1) << PROF_SUB_LOG2)
+
+typedef struct profile_hist {
+    uint64_t    buckets[PROF_BUCKETS];
+    uint64_t    count;
+    uint64_t    sum;
+} profile_hist_t;
+
+typedef struct profile_scope {
+    enum profile_event  event;
+    uint64_t            start;
+} profile_scope_t;
+
+static profile_hist_t profile_hists[PROF_EVENTS];
+static __thread uint64_t profile_nodes;     //nodes visited by the current find_fit
 
-#define HASH_SIZE 20
+static inline uint64_t profile_now(void);
+static inline void     profile_record(enum profile_event event, uint64_t value);
+static inline void     profile_scope_end(profile_scope_t * scope);
+void                   mm_profile_reset(void);      //Clears every histogram.
+void                   mm_profile_dump(FILE * out); //Prints count, mean, p50, p99 and p999 of every histogram.
 
-void* prologue_ptr = NULL; //pointer to the prologue block
-void* epilogue_ptr = NULL; //pointer to the epilogue block
-static void * segList[HASH_SIZE];
-bool dont_coalesce = false;
+/* Time the rest of the enclosing function, whichever way it returns */
+#define PROFILE_SCOPE(event) \
+    profile_scope_t profile_scope __attribute__((cleanup(profile_scope_end))) = { (event), profile_now() }
+#define PROFILE_NODE()      (profile_nodes++)
+
+#else
+
+#define PROFILE_SCOPE(event)
+#define PROFILE_NODE()
+
+#endif
+
+/* Bumped by mm_init so thread caches holding blocks of an old heap are discarded */
+static unsigned long heap_generation = 0;
+
+/* Per-thread cache of free blocks, one LIFO bin per small size class */
+typedef struct tcache {
+    void *        bins[TCACHE_BINS];
+    unsigned int  counts[TCACHE_BINS];
+    unsigned long generation;
+    arena_t *     arena;            //arena this thread allocates from
+    bool          registered;
+} tcache_t;
+
+static __thread tcache_t tcache;
+static pthread_key_t     tcache_key;
+static pthread_once_t    tcache_key_once = PTHREAD_ONCE_INIT;
 
 /**********************************************************
- * Hashing function that just calculates the log of 'key'
+ * Hashing function that maps 'key' to its size class. A
+ * count-leading-zeros finds the power of 2 and the bits
+ * just below the leading one pick the sub-bin.
  *
  * @param key = integer who's hash needs to be computed
  *
@@ -135,17 +718,170 @@ bool dont_coalesce = false;
  **********************************************************/
 static inline size_t map_size_class(size_t size)
 {
-    size_t size_class=0;
-    int val = 1;
-    for (size_class = 0 ; size_class < HASH_SIZE ; size_class++)
+    if (size <= (1UL << SIZE_CLASS_MIN_LOG2))
+    {
+        return 0;
+    }
+    if (size <= (1UL << SIZE_CLASS_SPLIT_LOG2))
+    {
+        return (size - 1) / DSIZE - 1;
+    }
+    size_t log2 = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(size - 1);
+    size_t sub_bin = ((size - 1) >> (log2 - SIZE_CLASS_SUBBINS_LOG2)) - SIZE_CLASS_SUBBINS;
+    size_t size_class = SIZE_CLASS_EXACT_BINS + ((log2 - SIZE_CLASS_SPLIT_LOG2) << SIZE_CLASS_SUBBINS_LOG2) + sub_bin;
+    return MIN(size_class, HASH_SIZE-1);
+}
+
+/**********************************************************
+ * size_class_max
+ * The largest block size hashing to a size class. The
+ * inverse of map_size_class, used to validate the bins.
+ *
+ * @param size_class - a hash table index below HASH_SIZE-1
+ *
+ * @return size_t the upper bound of the size class
+ *
+ **********************************************************/
+static inline size_t size_class_max(size_t size_class)
+{
+    if (size_class < SIZE_CLASS_EXACT_BINS)
+    {
+        return (size_class + 2) * DSIZE;
+    }
+    size_t log2 = SIZE_CLASS_SPLIT_LOG2 + ((size_class - SIZE_CLASS_EXACT_BINS) >> SIZE_CLASS_SUBBINS_LOG2);
+    size_t sub_bin = (size_class - SIZE_CLASS_EXACT_BINS) & (SIZE_CLASS_SUBBINS - 1);
+    return (SIZE_CLASS_SUBBINS + sub_bin + 1) << (log2 - SIZE_CLASS_SUBBINS_LOG2);
+}
+
+/**********************************************************
+ * tree_less
+ * Order of the large bin's tree: by size, then by address,
+ * so equal sizes come out lowest address first.
+ **********************************************************/
+static inline bool tree_less(void * a, void * b)
+{
+    return GET_SIZE(a) < GET_SIZE(b) || (GET_SIZE(a) == GET_SIZE(b) && a < b);
+}
+
+/**********************************************************
+ * tree_insert
+ * Insert a free block into the treap rooted at root. The
+ * heap priority of a node is a hash of its address, so the
+ * tree is balanced in expectation without storing anything
+ * beyond the two child links.
+ *
+ * @return void * the new root
+ **********************************************************/
+static void * tree_insert(void * root, void * node)
+{
+    if (root == NULL)
     {
-        if (size <= val)
+        SET_TREE_LEFT(node, NULL);
+        SET_TREE_RIGHT(node, NULL);
+        return node;
+    }
+
+    void * child;
+    if (tree_less(node, root))
+    {
+        child = tree_insert(TREE_LEFT(root), node);
+        SET_TREE_LEFT(root, child);
+        if (TREE_PRIORITY(child) > TREE_PRIORITY(root))
         {
-            break;
+            // Rotate right
+            SET_TREE_LEFT(root, TREE_RIGHT(child));
+            SET_TREE_RIGHT(child, root);
+            return child;
         }
-        val<<=1;
     }
-    return MIN(size_class, HASH_SIZE-1);
+    else
+    {
+        child = tree_insert(TREE_RIGHT(root), node);
+        SET_TREE_RIGHT(root, child);
+        if (TREE_PRIORITY(child) > TREE_PRIORITY(root))
+        {
+            // Rotate left
+            SET_TREE_RIGHT(root, TREE_LEFT(child));
+            SET_TREE_LEFT(child, root);
+            return child;
+        }
+    }
+    return root;
+}
+
+/**********************************************************
+ * tree_merge
+ * Join two treaps where every node of left orders before
+ * every node of right.
+ *
+ * @return void * the root of the joined treap
+ **********************************************************/
+static void * tree_merge(void * left, void * right)
+{
+    if (left == NULL)
+        return right;
+    if (right == NULL)
+        return left;
+
+    if (TREE_PRIORITY(left) > TREE_PRIORITY(right))
+    {
+        SET_TREE_RIGHT(left, tree_merge(TREE_RIGHT(left), right));
+        return left;
+    }
+    SET_TREE_LEFT(right, tree_merge(left, TREE_LEFT(right)));
+    return right;
+}
+
+/**********************************************************
+ * tree_remove
+ * Remove a free block from the treap rooted at root. The
+ * block must be in the tree.
+ *
+ * @return void * the new root
+ **********************************************************/
+static void * tree_remove(void * root, void * node)
+{
+    if (root == node)
+    {
+        return tree_merge(TREE_LEFT(node), TREE_RIGHT(node));
+    }
+
+    if (tree_less(node, root))
+    {
+        SET_TREE_LEFT(root, tree_remove(TREE_LEFT(root), node));
+    }
+    else
+    {
+        SET_TREE_RIGHT(root, tree_remove(TREE_RIGHT(root), node));
+    }
+    return root;
+}
+
+/**********************************************************
+ * tree_best_fit
+ * Find the smallest block of at least asize bytes in the
+ * treap, the lowest addressed one among equals.
+ *
+ * @return void * the block's header, or NULL if none fits
+ **********************************************************/
+static void * tree_best_fit(void * root, size_t asize)
+{
+    void * best = NULL;
+
+    while (root != NULL)
+    {
+        PROFILE_NODE();
+        if (GET_SIZE(root) >= asize)
+        {
+            best = root;
+            root = TREE_LEFT(root);
+        }
+        else
+        {
+            root = TREE_RIGHT(root);
+        }
+    }
+    return best;
 }
 
 /**********************************************************
@@ -158,14 +894,14 @@ static inline size_t map_size_class(size_t size)
  *                False otherwise.
  *
  **********************************************************/
-bool is_block_in_seglist(void * block)
+bool is_block_in_seglist(arena_t * arena, void * block)
 {
     size_t index = 0;
     
     //Traverse entire segregated list
     while (index < HASH_SIZE)
     {
-        void * list_root = segList[index];
+        void * list_root = arena->segList[index];
         while (list_root!=NULL)
         {
             if (block == list_root) //Looks like the block pointer exists in the list
@@ -191,22 +927,47 @@ bool is_block_in_seglist(void * block)
  * @return void
  *
  **********************************************************/
-void insert_free_block(void * free_block)
+void insert_free_block(arena_t * arena, void * free_block)
 {
     // Make sure the block does not already exist in the segregated free list
-    //  assert(!is_block_in_seglist(free_block));
+    //  assert(!is_block_in_seglist(arena, free_block));
 
     size_t index = map_size_class(GET_SIZE(free_block));
-    void* old_first_block = segList[index];
-    segList[index] = free_block;
+    void* old_first_block = arena->segList[index];
+    void* prev_block = NULL;
+    arena->binmap[BINMAP_WORD(index)] |= BINMAP_BIT(index);
+    STAT_ADD(arena->stats.free_blocks[index], 1);
+    STAT_ADD(arena->stats.free_bytes[index], GET_SIZE(free_block));
+
+    if (index == LARGE_BIN)
+    {
+        arena->large_tree = tree_insert(arena->large_tree, free_block);
+    }
+
+#if FIT_POLICY == FIT_ADDRESS
+    // Keep the bin sorted by address so the first fit is also the lowest one
+    while (old_first_block && old_first_block < free_block)
+    {
+        prev_block = old_first_block;
+        old_first_block = (void *)GET_PRED_PTR(old_first_block);
+    }
+#endif
 
     SET_PRED_PTR(free_block, (uintptr_t)old_first_block);
-    SET_SUCC_PTR(free_block, (uintptr_t)NULL);
+    SET_SUCC_PTR(free_block, (uintptr_t)prev_block);
 
     if (old_first_block)
     {
         SET_SUCC_PTR(old_first_block, (uintptr_t)free_block);
     }
+    if (prev_block)
+    {
+        SET_PRED_PTR(prev_block, (uintptr_t)free_block);
+    }
+    else
+    {
+        arena->segList[index] = free_block;
+    }
 
     return;
 }
@@ -221,10 +982,10 @@ void insert_free_block(void * free_block)
  *                false otherwise.
  *
  **********************************************************/
-bool is_block_in_freelist(void * block)
+bool is_block_in_freelist(arena_t * arena, void * block)
 {
     size_t index = map_size_class(GET_SIZE(block));
-    void * list_root = segList[index];
+    void * list_root = arena->segList[index];
 
     while (list_root!=NULL)
     {
@@ -248,13 +1009,21 @@ bool is_block_in_freelist(void * block)
  * @return void
  *
  **********************************************************/
-void remove_free_block(void * free_block)
+void remove_free_block(arena_t * arena, void * free_block)
 {
     // Make sure the block is in the proper bin in the segregated free list
-    // assert(is_block_in_freelist(free_block));
+    // assert(is_block_in_freelist(arena, free_block));
 
     uintptr_t next = GET_PRED_PTR(free_block); // next pointer
     uintptr_t prev = GET_SUCC_PTR(free_block); // prev pointer
+    size_t index = map_size_class(GET_SIZE(free_block));
+
+    STAT_SUB(arena->stats.free_blocks[index], 1);
+    STAT_SUB(arena->stats.free_bytes[index], GET_SIZE(free_block));
+    if (index == LARGE_BIN)
+    {
+        arena->large_tree = tree_remove(arena->large_tree, free_block);
+    }
 
     if (next)
     {
@@ -267,447 +1036,3135 @@ void remove_free_block(void * free_block)
     }
     else
     {
-        int index = map_size_class(GET_SIZE(free_block));
-        segList[index] = (void *)next;
+        arena->segList[index] = (void *)next;
+        if (!next)
+        {
+            arena->binmap[BINMAP_WORD(index)] &= ~BINMAP_BIT(index);
+        }
     }
 
     return;
 }
 
 /**********************************************************
- * mm_init
- * Initialize the heap, including "allocation" of the
- * prologue and epilogue
+ * arena_init_heap
+ * Lay down the prologue and epilogue of an empty arena
+ * heap and empty its segregated list.
  **********************************************************/
-int mm_init(void)
+static int arena_init_heap(arena_t * arena)
 {
-//  mm_check();
-
-    void* heap_listp;
-    if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1)
+    char* heap_listp;
+    if ((heap_listp = arena_sbrk(arena, 2*DSIZE)) == (void *)-1)
         {return -1;}
-    PUT(heap_listp, 0);                         // alignment padding
-    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1));   // prologue header
-    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1));   // prologue footer
-    PUT(heap_listp + (3 * WSIZE), PACK(0, 1));    // epilogue header
-    prologue_ptr = heap_listp + (1 * WSIZE);
-    epilogue_ptr = heap_listp + (3 * WSIZE);
+    memset(heap_listp, 0, DSIZE - TSIZE);      // alignment padding
+    PUT(heap_listp + DSIZE - TSIZE, PACK(DSIZE, 1 | PREV_ALLOC));       // prologue header
+    PUT(heap_listp + 2*DSIZE - 2*TSIZE, PACK(DSIZE, 1));               // prologue footer
+    PUT(heap_listp + 2*DSIZE - TSIZE, PACK(0, 1 | PREV_ALLOC));         // epilogue header
+    arena->prologue_ptr = heap_listp + DSIZE - TSIZE;
+    arena->epilogue_ptr = heap_listp + 2*DSIZE - TSIZE;
+    arena->top = NULL;
+    arena->top_grow = TOP_GROW_MIN;
+    arena->top_clean = heap_listp;
+    arena->top_zero = TOP_ZERO_NONE;
 
-    heap_listp += DSIZE;
-
-    int itr=0;
+    size_t itr=0;
     for(; itr<HASH_SIZE; itr++)
     {
-        segList[itr] = (void *)NULL;    //initialize each element in the segregated free list to NULL
+        arena->segList[itr] = (void *)NULL;    //initialize each element in the segregated free list to NULL
     }
+    arena->large_tree = NULL;
+    arena->check_cursor = NULL;
+    memset(arena->binmap, 0, sizeof(arena->binmap));
+    memset(&arena->stats, 0, sizeof(arena->stats));
+    memset(arena->slab_runs, 0, sizeof(arena->slab_runs));
+    memset(arena->quick, 0, sizeof(arena->quick));
+    arena->quick_bytes = 0;
+    arena->remote_free = NULL;
 
     return 0;
 }
 
 /**********************************************************
- * coalesce
- * Covers the 4 cases discussed in the text:
- * - both neighbours are allocated
- * - the next block is available for coalescing
- * - the previous block is available for coalescing
- * - both neighbours are available for coalescing
+ * huge_advise
+ * Ask for the whole huge pages between start and end to be
+ * backed by transparent huge pages. Does nothing unless
+ * HUGE_PAGES is set. The advice is only a hint, so failure
+ * is ignored.
  **********************************************************/
-void *coalesce(void *bp)
+static void huge_advise(char * start, char * end)
 {
-    /******************************************************
-     * Steps for coalescing:
-     * 1) Check if two blocks beside current block is free
-     * 2) If there is a block to the left, update 
-     *    its header with new length
-     *       a)Otherwise, update current block's header 
-     *         with new length
-     * 3) If there is a block to the right, update its 
-     *    footer with new length
-     *       b)Otherwise, update current block's footer 
-     *         with new length
-     *
-     * NOTE: I'm assuming that the current block bp was
-     * never in the free list to begin with. May be worth
-     * revisiting.
-     ******************************************************/
-
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
-
-    //Let's calculate the header pointer of all three blocks
-    void *prev_header = HDRP(PREV_BLKP(bp));
-    void *next_header = HDRP(NEXT_BLKP(bp));
-
-    //Let's calculate the footer pointer of all three blocks
-    void *next_footer = FTRP(NEXT_BLKP(bp));
-
-    
-    if (prev_alloc && next_alloc)               /* Case 1 - No coalescing necessary*/
+#if HUGE_PAGES
+    start = HUGE_ALIGN_UP(start);
+    end = HUGE_ALIGN_DOWN(end);
+    if (start < end)
     {
-        return bp;
+        madvise(start, end - start, MADV_HUGEPAGE);
     }
+#else
+    (void)start;
+    (void)end;
+#endif
+}
 
-    else if (prev_alloc && !next_alloc)        /* Case 2 - Coalesce current block with the next block */
+/**********************************************************
+ * arena_sbrk
+ * Grow the heap region of an arena by incr bytes.
+ *
+ * @return void * the old end of the region, or (void *)-1
+ *                if the arena is out of address space
+ *
+ **********************************************************/
+static void * arena_sbrk(arena_t * arena, size_t incr)
+{
+    if (arena == &main_arena)
     {
-        // Remove next block from the appropriate free list
-        remove_free_block(next_header);
-
-        // Merge the prev and curr blocks
-        size += GET_SIZE(next_header);
-
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(next_footer, PACK(size, 0));
-        
-        return (bp);
+        // mem_sbrk takes an int, larger increments would be truncated
+        if (incr > INT_MAX)
+        {
+            return (void *)-1;
+        }
+        return mem_sbrk(incr);
     }
 
-    else if (!prev_alloc && next_alloc)        /* Case 3 - Coalesce current block with the previous  */
+    if (incr > (size_t)(arena->limit - arena->brk))
     {
-        // Remove next block from the appropriate free list
-        remove_free_block(prev_header);
-        
-        // Merge the next and curr blocks
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-
-        return (PREV_BLKP(bp));
+        return (void *)-1;
     }
 
-    else            /* Case 4 - Coalesce current block with both the previous and next block*/
-    {
-        // Remove the prev and next block from the appropriate free lists
-        remove_free_block(prev_header);
-        remove_free_block(next_header);
-
-        // Merge the prev, curr, and next blocks
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)))  +
-            GET_SIZE(next_footer)  ;
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size,0));
-        PUT(next_footer, PACK(size,0));
-
-        return (PREV_BLKP(bp));
-    }
+    char * old_brk = arena->brk;
+    arena->brk += incr;
+    return old_brk;
 }
 
 /**********************************************************
- * extend_heap
- * Extend the heap by "words" words, maintaining alignment
- * requirements of course. Free the former epilogue block
- * and reallocate its new header
+ * arena_create
+ * Reserve an ARENA_HEAP_SIZE-aligned region for a secondary
+ * arena. The arena_t lives at the base of the region so
+ * arena_for_block can recover it by masking an address.
+ *
+ * @return arena_t * the new arena, or NULL if the
+ *                   reservation failed
+ *
  **********************************************************/
-void *extend_heap(size_t size)
+static arena_t * arena_create(void)
 {
-    char *bp;
-
-    // If the previous block is free, only extend the heap by (size - size_of_prev_free_block) so that you reduce external fragmentation
-    size_t size_prev_free = GET_SIZE(epilogue_ptr-WSIZE) * !GET_ALLOC(epilogue_ptr-WSIZE);
-    size -= size_prev_free;
-
-    assert (size % DSIZE == 0);
-
-    if ( (bp = mem_sbrk(size)) == (void *)-1 )
+    // Over-reserve so an aligned region can be cut out of the mapping
+    char * map = mmap(NULL, 2 * ARENA_HEAP_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
     {
         return NULL;
     }
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));                // free block header
-    PUT(FTRP(bp), PACK(size, 0));                // free block footer
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));        // new epilogue header
+    char * base = (char *)(((uintptr_t)map + ARENA_HEAP_SIZE - 1) & ~(ARENA_HEAP_SIZE - 1));
+    if (base > map)
+    {
+        munmap(map, base - map);
+    }
+    munmap(base + ARENA_HEAP_SIZE, (map + 2 * ARENA_HEAP_SIZE) - (base + ARENA_HEAP_SIZE));
 
-    epilogue_ptr = HDRP(NEXT_BLKP(bp));
+    huge_advise(base, base + ARENA_HEAP_SIZE);
 
-    /* Coalesce if the previous block was free */
-    return coalesce(bp);
-}
+    arena_t * arena = (arena_t *)base;
+    pthread_mutex_init(&arena->lock, NULL);
+    arena->brk = base + DSIZE * ((sizeof(arena_t) + DSIZE - 1) / DSIZE);
+    arena->limit = base + ARENA_HEAP_SIZE;
+
+    if (arena_init_heap(arena) == -1)
+    {
+        munmap(base, ARENA_HEAP_SIZE);
+        return NULL;
+    }
+    return arena;
+}
+
+/**********************************************************
+ * arena_for_block
+ * Find the arena owning a block. Slab slots record it in
+ * their run header. Secondary arenas are aligned to
+ * ARENA_HEAP_SIZE, anything else belongs to the main arena.
+ *
+ * @param bp - a block pointer handed out by mm_malloc
+ *
+ * @return arena_t * the owning arena
+ *
+ **********************************************************/
+static arena_t * arena_for_block(void * bp)
+{
+    if (IS_SLAB_PTR(bp))
+    {
+        return SLAB_RUN(bp)->arena;
+    }
+
+    arena_t * base = (arena_t *)((uintptr_t)bp & ~(ARENA_HEAP_SIZE - 1));
+    size_t index;
+
+    for (index = 1; index < NUM_ARENAS; index++)
+    {
+        if (__atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE) == base)
+        {
+            return base;
+        }
+    }
+    return &main_arena;
+}
+
+/**********************************************************
+ * arena_assign
+ * Pick the next arena round-robin, creating it on first use.
+ * Falls back to the main arena if it cannot be reserved.
+ **********************************************************/
+static arena_t * arena_assign(void)
+{
+    size_t index = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % NUM_ARENAS;
+    arena_t * arena = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+
+    if (arena == NULL)
+    {
+        pthread_mutex_lock(&arenas_lock);
+        if ((arena = arenas[index]) == NULL)
+        {
+            arena = arena_create();
+            __atomic_store_n(&arenas[index], arena, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&arenas_lock);
+    }
+
+    return arena ? arena : &main_arena;
+}
+
+/**********************************************************
+ * slab_reserve
+ * Reserve the slab region on first use. With HUGE_PAGES it
+ * is aligned to a huge page, so the runs of the hot small
+ * size classes are packed into huge pages from the start.
+ * The caller must hold slab_lock.
+ **********************************************************/
+static int slab_reserve(void)
+{
+    size_t slack = HUGE_PAGES ? HUGE_PAGE_SIZE : 0;
+    char * map = mmap(NULL, SLAB_REGION_SIZE + slack, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    char * base = HUGE_PAGES ? HUGE_ALIGN_UP(map) : map;
+    if (base > map)
+    {
+        munmap(map, base - map);
+    }
+    if (map + slack > base)
+    {
+        munmap(base + SLAB_REGION_SIZE, map + slack - base);
+    }
+    huge_advise(base, base + SLAB_REGION_SIZE);
+
+    // Publish the size last so IS_SLAB_PTR never sees a size without its base
+    slab_base = base;
+    slab_brk = base;
+    __atomic_store_n(&slab_size, SLAB_REGION_SIZE, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**********************************************************
+ * slab_run_create
+ * Take an empty run from the slab region and format it
+ * into slots of one slab class, all of them free.
+ * The caller must hold the arena lock.
+ *
+ * @return slab_run_t * the new run, or NULL if the slab
+ *                      region is exhausted
+ *
+ **********************************************************/
+static slab_run_t * slab_run_create(arena_t * arena, size_t slab_class)
+{
+    slab_run_t * run;
+
+    pthread_mutex_lock(&slab_lock);
+    if ((run = slab_free_runs) != NULL)
+    {
+        slab_free_runs = run->next;
+    }
+    else if ((slab_size != 0 || slab_reserve() == 0) && slab_brk < slab_base + slab_size)
+    {
+        run = (slab_run_t *)slab_brk;
+        slab_brk += SLAB_RUN_SIZE;
+        __atomic_fetch_add(&slab_bytes, SLAB_RUN_SIZE, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&slab_lock);
+
+    if (run == NULL)
+    {
+        return NULL;
+    }
+
+    run->arena = arena;
+    run->slot_size = SLAB_SLOT_SIZE(slab_class);
+    run->nslots = (SLAB_RUN_SIZE - SLAB_RUN_HDR) / run->slot_size;
+    run->nfree = run->nslots;
+
+    // Mark the first nslots slots free
+    size_t word;
+    for (word = 0; word < SLAB_FREEMAP_WORDS; word++)
+    {
+        size_t first = word * BINMAP_BITS;
+        if (first + BINMAP_BITS <= run->nslots)
+            run->freemap[word] = ~0UL;
+        else if (first < run->nslots)
+            run->freemap[word] = (1UL << (run->nslots - first)) - 1;
+        else
+            run->freemap[word] = 0;
+    }
+
+    // Push onto the arena's list of runs with free slots
+    run->prev = NULL;
+    run->next = arena->slab_runs[slab_class];
+    if (run->next)
+    {
+        run->next->prev = run;
+    }
+    arena->slab_runs[slab_class] = run;
+
+    return run;
+}
+
+/**********************************************************
+ * slab_unlink_run
+ * Remove a run from its arena's list of runs with free
+ * slots. The caller must hold the arena lock.
+ **********************************************************/
+static void slab_unlink_run(arena_t * arena, slab_run_t * run)
+{
+    if (run->next)
+    {
+        run->next->prev = run->prev;
+    }
+    if (run->prev)
+    {
+        run->prev->next = run->next;
+    }
+    else
+    {
+        arena->slab_runs[SLAB_CLASS(run->slot_size)] = run->next;
+    }
+}
+
+/**********************************************************
+ * slab_alloc
+ * Take a free slot of a slab class from the arena.
+ * The caller must hold the arena lock.
+ *
+ * @return void * the slot, or NULL if no run is available
+ *
+ **********************************************************/
+static void * slab_alloc(arena_t * arena, size_t slab_class)
+{
+    slab_run_t * run = arena->slab_runs[slab_class];
+
+    if (run == NULL && (run = slab_run_create(arena, slab_class)) == NULL)
+    {
+        return NULL;
+    }
+
+    size_t word = 0;
+    while (run->freemap[word] == 0)
+    {
+        word++;
+    }
+    size_t bit = __builtin_ctzl(run->freemap[word]);
+    run->freemap[word] &= ~(1UL << bit);
+
+    // A full run leaves the list until one of its slots is freed
+    if (--run->nfree == 0)
+    {
+        slab_unlink_run(arena, run);
+    }
+
+    return (char *)run + SLAB_RUN_HDR + (word * BINMAP_BITS + bit) * run->slot_size;
+}
+
+/**********************************************************
+ * slab_free
+ * Return a slot to its run. A run that becomes entirely
+ * free goes back to the slab region unless it is the only
+ * run of its class left in the arena.
+ * The caller must hold the lock of the run's arena.
+ **********************************************************/
+static void slab_free(arena_t * arena, void * bp)
+{
+    slab_run_t * run = SLAB_RUN(bp);
+    size_t slab_class = SLAB_CLASS(run->slot_size);
+    size_t slot = ((char *)bp - ((char *)run + SLAB_RUN_HDR)) / run->slot_size;
+
+    run->freemap[slot / BINMAP_BITS] |= 1UL << (slot % BINMAP_BITS);
+
+    if (++run->nfree == 1)
+    {
+        // Was full, so it is not on the list
+        run->prev = NULL;
+        run->next = arena->slab_runs[slab_class];
+        if (run->next)
+        {
+            run->next->prev = run;
+        }
+        arena->slab_runs[slab_class] = run;
+    }
+    else if (run->nfree == run->nslots && (run->prev || run->next))
+    {
+        slab_unlink_run(arena, run);
+
+        pthread_mutex_lock(&slab_lock);
+        run->next = slab_free_runs;
+        slab_free_runs = run;
+        pthread_mutex_unlock(&slab_lock);
+    }
+}
+
+/**********************************************************
+ * mmap_alloc
+ * Serve a request of at least mmap_threshold bytes from its
+ * own anonymous mapping, with the payload aligned to
+ * alignment bytes (a power of two, at least DSIZE). The
+ * payload is preceded by a word holding its offset into the
+ * mapping and a header with the mapping length and the
+ * MMAPPED bit. Whole pages of alignment padding in front
+ * of the offset word and behind the payload are unmapped
+ * again. Such blocks never enter an arena. With HUGE_PAGES,
+ * payloads of a huge page or more start on a huge page
+ * boundary.
+ *
+ * @return void * the payload, or NULL if the mapping failed
+ **********************************************************/
+static void * mmap_alloc(size_t size, size_t alignment)
+{
+    // Start the payload on a huge page boundary, so all of it but the tail can use huge pages
+    if (HUGE_PAGES && size >= HUGE_PAGE_SIZE)
+    {
+        alignment = MAX(alignment, HUGE_PAGE_SIZE);
+    }
+    size_t lead = MAX(alignment, MMAP_OVERHEAD);
+    if (size > SIZE_MAX - lead - page_size)
+    {
+        return NULL;
+    }
+
+    // The first aligned address past the words in front of the payload is at most lead bytes in
+    size_t map_size = (size_t)PAGE_ALIGN_UP(size + lead);
+    char * base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    char * bp = (char *)(((uintptr_t)base + MMAP_OVERHEAD + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    char * start = PAGE_ALIGN_DOWN(bp - MMAP_OVERHEAD);
+    char * end = PAGE_ALIGN_UP(bp + size);
+    if (start != base)
+    {
+        munmap(base, start - base);
+    }
+    if (end != base + map_size)
+    {
+        munmap(end, base + map_size - end);
+    }
+    map_size = end - start;
+
+    PUT_WORD(MMAP_OFFSET_PTR(bp), bp - start);
+    SET_MMAP_HEADER(bp, map_size);
+    huge_advise(bp, end);
+
+    __atomic_fetch_add(&mmap_blocks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&mmap_bytes, map_size, __ATOMIC_RELAXED);
+    return bp;
+}
+
+/**********************************************************
+ * mmap_free
+ * Unmap a block returned by mmap_alloc. With MMAP_ADAPTIVE,
+ * also raise the mmap threshold past its size.
+ **********************************************************/
+static void mmap_free(void * bp)
+{
+    size_t offset = GET_WORD(MMAP_OFFSET_PTR(bp));
+    size_t map_size = MMAP_LENGTH(bp);
+    munmap((char *)bp - offset, map_size);
+    __atomic_fetch_sub(&mmap_blocks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&mmap_bytes, map_size, __ATOMIC_RELAXED);
+
+    // Sizes up to this mapping's are being freed again, so the heap can recycle them
+    if (MMAP_ADAPTIVE && map_size < MMAP_THRESHOLD_MAX && map_size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&mmap_threshold, map_size + DSIZE, __ATOMIC_RELAXED);
+    }
+}
+
+/**********************************************************
+ * mmap_realloc
+ * Resize the mapping of a block returned by mmap_alloc.
+ * mremap moves the pages rather than copying them when the
+ * mapping cannot grow in place.
+ *
+ * @return void * the payload, possibly moved, or NULL if
+ *                the mapping could not be resized, in which
+ *                case the old block is untouched
+ **********************************************************/
+static void * mmap_realloc(void * bp, size_t size)
+{
+    size_t offset = GET_WORD(MMAP_OFFSET_PTR(bp));
+    size_t old_size = MMAP_LENGTH(bp);
+
+    if (size > SIZE_MAX - offset - page_size)
+    {
+        return NULL;
+    }
+
+    size_t map_size = (size_t)PAGE_ALIGN_UP(size + offset);
+    if (map_size == old_size)
+    {
+        return bp;
+    }
+
+    char * base = mremap((char *)bp - offset, old_size, map_size, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    bp = base + offset;
+    SET_MMAP_HEADER(bp, map_size);
+    __atomic_fetch_add(&mmap_bytes, map_size - old_size, __ATOMIC_RELAXED);
+    return bp;
+}
+
+/**********************************************************
+ * mm_init
+ * Initialize the heap, including "allocation" of the
+ * prologue and epilogue. Secondary arenas and slab runs
+ * left over from a previous heap are unmapped.
+ **********************************************************/
+int mm_init(void)
+{
+//  mm_check();
+
+    size_t index;
+    for (index = 1; index < NUM_ARENAS; index++)
+    {
+        if (arenas[index] != NULL)
+        {
+            munmap(arenas[index], ARENA_HEAP_SIZE);
+            arenas[index] = NULL;
+        }
+    }
+    next_arena = 0;
+    page_size = mem_pagesize();
+    mmap_threshold = MMAP_THRESHOLD;
+    mmap_blocks = 0;
+    mmap_bytes = 0;
+    slab_bytes = 0;
+
+    if (slab_size != 0)
+    {
+        munmap(slab_base, slab_size);
+        slab_base = NULL;
+        slab_size = 0;
+        slab_free_runs = NULL;
+    }
+
+    if (arena_init_heap(&main_arena) == -1)
+        {return -1;}
+
+    // Blocks cached by any thread belong to the old heap
+    heap_generation++;
+
+    return 0;
+}
+
+/**********************************************************
+ * remove_free_or_top
+ * Take a free block out of circulation before it is merged
+ * into a neighbour. The top chunk is not on any list, it
+ * just stops being the top chunk.
+ **********************************************************/
+static inline void remove_free_or_top(arena_t * arena, void * free_block)
+{
+    if ((char *)free_block + TSIZE == arena->top)
+    {
+        arena->top = NULL;
+    }
+    else
+    {
+        remove_free_block(arena, free_block);
+    }
+}
+
+/**********************************************************
+ * coalesce
+ * Covers the 4 cases discussed in the text:
+ * - both neighbours are allocated
+ * - the next block is available for coalescing
+ * - the previous block is available for coalescing
+ * - both neighbours are available for coalescing
+ **********************************************************/
+void *coalesce(arena_t * arena, void *bp)
+{
+    PROFILE_SCOPE(PROF_COALESCE);
+
+    /******************************************************
+     * Steps for coalescing:
+     * 1) Check if two blocks beside current block is free
+     * 2) If there is a block to the left, update 
+     *    its header with new length
+     *       a)Otherwise, update current block's header 
+     *         with new length
+     * 3) If there is a block to the right, update its 
+     *    footer with new length
+     *       b)Otherwise, update current block's footer 
+     *         with new length
+     *
+     * The previous block only has a footer when it is free,
+     * so its state is read from the prev-alloc bit of the
+     * current header rather than from its footer.
+     *
+     * NOTE: I'm assuming that the current block bp was
+     * never in the free list to begin with. May be worth
+     * revisiting.
+     ******************************************************/
+
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    //Let's calculate the header pointer of the next block
+    void *next_header = HDRP(NEXT_BLKP(bp));
+
+    
+    if (prev_alloc && next_alloc)               /* Case 1 - No coalescing necessary*/
+    {
+        STAT_ADD(arena->stats.coalesces[0], 1);
+        return bp;
+    }
+
+    else if (prev_alloc && !next_alloc)        /* Case 2 - Coalesce current block with the next block */
+    {
+        // Remove next block from the appropriate free list
+        remove_free_or_top(arena, next_header);
+        STAT_ADD(arena->stats.coalesces[1], 1);
+        CHECK_CURSOR_ABSORB(arena, NEXT_BLKP(bp), bp);
+
+        // Merge the prev and curr blocks
+        size += GET_SIZE(next_header);
+
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, 0));
+        
+        return (bp);
+    }
+
+    else if (!prev_alloc && next_alloc)        /* Case 3 - Coalesce current block with the previous  */
+    {
+        void *prev_header = HDRP(PREV_BLKP(bp));
+
+        // Remove next block from the appropriate free list
+        remove_free_block(arena, prev_header);
+        STAT_ADD(arena->stats.coalesces[2], 1);
+        CHECK_CURSOR_ABSORB(arena, bp, PREV_BLKP(bp));
+        
+        // Merge the next and curr blocks
+        size += GET_SIZE(prev_header);
+        PUT(FTRP(bp), PACK(size, 0));
+        PUT(prev_header, PACK(size, GET_PREV_ALLOC(prev_header)));
+
+        return (PREV_BLKP(bp));
+    }
+
+    else            /* Case 4 - Coalesce current block with both the previous and next block*/
+    {
+        void *prev_header = HDRP(PREV_BLKP(bp));
+
+        // Remove the prev and next block from the appropriate free lists
+        remove_free_block(arena, prev_header);
+        remove_free_or_top(arena, next_header);
+        STAT_ADD(arena->stats.coalesces[3], 1);
+        CHECK_CURSOR_ABSORB(arena, bp, PREV_BLKP(bp));
+        CHECK_CURSOR_ABSORB(arena, NEXT_BLKP(bp), PREV_BLKP(bp));
+
+        // Merge the prev, curr, and next blocks
+        size += GET_SIZE(prev_header)  +
+            GET_SIZE(next_header)  ;
+        PUT(prev_header, PACK(size, GET_PREV_ALLOC(prev_header)));
+        PUT(FTRP(PREV_BLKP(bp)), PACK(size,0));
+
+        return (PREV_BLKP(bp));
+    }
+}
+
+/**********************************************************
+ * extend_heap
+ * Grow the top chunk until it holds at least size bytes,
+ * maintaining alignment requirements of course. The heap
+ * grows by at least the arena's current growth step, which
+ * doubles with every extension up to TOP_GROW_MAX, so a
+ * fresh heap ramps up in a few large steps instead of one
+ * extension per allocation. The former epilogue header
+ * becomes the header of the new space. Space from an mmap
+ * reservation, or from mem_sbrk if MEM_SBRK_CLEARS, is
+ * zero and extends the known-zero tail of the top chunk.
+ * With HUGE_PAGES, the heap grows to a huge page boundary.
+ *
+ * @return void * the top chunk, or NULL if the heap
+ *                cannot grow
+ **********************************************************/
+void *extend_heap(arena_t * arena, size_t size)
+{
+    PROFILE_SCOPE(PROF_EXTEND_HEAP);
+    char *bp;
+
+    // The top chunk already covers part of the request, so only extend the heap by the difference
+    size_t top_size = arena->top ? GET_SIZE(HDRP(arena->top)) : 0;
+    size_t needed = size - top_size;
+    size_t grow = MAX(needed, arena->top_grow);
+    char * old_brk = (char *)arena->epilogue_ptr + TSIZE;
+
+    assert (needed % DSIZE == 0);
+
+    // End the heap on a huge page boundary, so no huge page is shared with the next extension
+    if (HUGE_PAGES)
+    {
+        grow = HUGE_ALIGN_UP(old_brk + grow) - old_brk;
+    }
+
+#if COMPACT_HEADERS
+    // Stay within the heap size that block sizes in a compact header can describe
+    size_t room = COMPACT_HEAP_MAX - (old_brk - (char *)arena->prologue_ptr);
+    if (needed > room)
+    {
+        return NULL;
+    }
+    grow = MIN(grow, room);
+#endif
+
+    if ( (bp = arena_sbrk(arena, grow)) == (void *)-1 )
+    {
+        // Fall back to exactly what is missing before giving up
+        grow = needed;
+        if ( (bp = arena_sbrk(arena, grow)) == (void *)-1 )
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        arena->top_grow = MIN(2 * arena->top_grow, TOP_GROW_MAX);
+    }
+    STAT_ADD(arena->stats.extend_calls, 1);
+    STAT_ADD(arena->stats.extend_bytes, grow);
+
+    // Secondary arenas advised their whole reservation when they were created
+    if (arena == &main_arena)
+    {
+        huge_advise(old_brk, old_brk + grow);
+    }
+
+    /* Initialize free block header/footer and the epilogue header */
+    PUT(HDRP(bp), PACK(grow, GET_PREV_ALLOC(HDRP(bp))));  // free block header
+    PUT(FTRP(bp), PACK(grow, 0));                // free block footer
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));        // new epilogue header
+
+    arena->epilogue_ptr = HDRP(NEXT_BLKP(bp));
+
+    /* Merge the new space into the top chunk, and keep track of how much of it is zero */
+    bool fresh = MEM_SBRK_CLEARS || arena != &main_arena;
+    if (arena->top)
+    {
+        char * old_footer = FTRP(arena->top);
+        if (!fresh)
+        {
+            arena->top_zero = TOP_ZERO_NONE;
+        }
+        else if (arena->top_zero <= old_footer)
+        {
+            // Wipe the old footer and epilogue so the zero tail runs on into the new space
+            PUT(old_footer, 0);
+            PUT(HDRP(bp), 0);
+        }
+        else
+        {
+            arena->top_zero = bp;
+        }
+        bp = arena->top;
+        PUT(HDRP(bp), PACK(top_size + grow, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(top_size + grow, 0));
+    }
+    else
+    {
+        arena->top_zero = fresh ? bp : TOP_ZERO_NONE;
+    }
+    arena->top = bp;
+    return bp;
+}
+
+/**********************************************************
+ * carve_top
+ * Split asize bytes off the front of the top chunk. What
+ * is left stays the top chunk, unless it is smaller than a
+ * minimum block, in which case it goes with the allocation.
+ * The caller must make sure the top chunk holds asize bytes.
+ *
+ * @return void * the carved block, still marked free
+ **********************************************************/
+static void * carve_top(arena_t * arena, size_t asize)
+{
+    char * bp = arena->top;
+    size_t top_size = GET_SIZE(HDRP(bp));
+
+    if (top_size - asize >= MIN_BLOCK)
+    {
+        PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp))));
+        arena->top = NEXT_BLKP(bp);
+        PUT(HDRP(arena->top), PACK(top_size - asize, 0));
+        PUT(FTRP(arena->top), PACK(top_size - asize, 0));
+
+        // Pages under the new top header are resident again, and it is no longer zero
+        arena->top_clean = MAX(arena->top_clean, PAGE_ALIGN_UP((char *)arena->top));
+        arena->top_zero = MAX(arena->top_zero, (char *)arena->top);
+        STAT_ADD(arena->stats.splits, 1);
+    }
+    else
+    {
+        arena->top = NULL;
+        arena->top_zero = TOP_ZERO_NONE;
+    }
+
+    return bp;
+}
+
+/**********************************************************
+ * trim_top
+ * Give the pages of the top chunk beyond its first pad
+ * bytes back to the OS. The address space stays part of
+ * the heap and faults back in as zero pages when the top
+ * chunk is carved again. Pages from top_clean upwards were
+ * already released, so a run of frees into the top chunk
+ * only pays for the new pages.
+ * The caller must hold the arena lock.
+ *
+ * @return bool - true if any pages were released
+ **********************************************************/
+static bool trim_top(arena_t * arena, size_t pad)
+{
+    char * bp = arena->top;
+
+    if (bp == NULL || GET_SIZE(HDRP(bp)) <= pad)
+    {
+        return false;
+    }
+
+    // Pages from top_clean up are released already, so the huge page holding it can go as a whole
+    char * start = TRIM_ALIGN_UP(bp + pad);
+    char * end = MIN(TRIM_ALIGN_UP(arena->top_clean), TRIM_ALIGN_DOWN(FTRP(bp)));
+
+    if (start < end && madvise(start, end - start, TRIM_ADVICE) == 0)
+    {
+        arena->top_clean = start;
+        // Released pages fault back in as zero pages, which may extend the known-zero tail
+        if (TRIM_ADVICE == MADV_DONTNEED && arena->top_zero <= end)
+        {
+            arena->top_zero = MIN(arena->top_zero, start);
+        }
+        return true;
+    }
+    return false;
+}
+
+/**********************************************************
+ * release_block_pages
+ * Give the whole pages of a free block that fall between
+ * from and to back to the OS, whole huge pages only with
+ * HUGE_PAGES. The header, list and treap
+ * links and footer of the block stay resident.
+ * The caller must hold the arena lock.
+ *
+ * @return bool - true if any pages were released
+ **********************************************************/
+static bool release_block_pages(void * bp, char * from, char * to)
+{
+    char * start = TRIM_ALIGN_UP(MAX(from, LINKS_END(bp)));
+    char * end = TRIM_ALIGN_DOWN(MIN(to, FTRP(bp)));
+
+    return start < end && madvise(start, end - start, TRIM_ADVICE) == 0;
+}
+
+/**********************************************************
+ * break_block_and_return_bp
+ * Breaks the block into two segments: one block consisting 
+ * of asize bytes and another with a size
+ * of original block size minus asize
+ *
+ * @param block - A pointer to the block
+ * @param asize - The size needed from the block
+ *
+ * @return void * the pointer to the block with size asize
+ *
+ **********************************************************/
+void * break_block_and_return_bp(arena_t * arena, void * block, size_t asize)
+{
+    size_t block_size = GET_SIZE(block);
+    remove_free_block(arena, block);
+
+    size_t fragment_size = block_size - asize;
+
+    // If fragment is the minimum size of a free block, break it up
+    if (fragment_size >= MIN_BLOCK)
+    {
+        // Create a block of asize. It is about to be allocated,
+        // so it needs no footer.
+        PUT(block, PACK(asize, GET_PREV_ALLOC(block)));
+
+        // Create a block of fragment_size. place() sets its
+        // prev-alloc bit once the first block is allocated.
+        PUT(block+asize, PACK(fragment_size,0));
+        PUT(block+block_size-TSIZE, PACK(fragment_size,0));
+
+        // Add the new fragment to the segList
+        insert_free_block(arena, block+asize);
+        STAT_ADD(arena->stats.splits, 1);
+    }
+
+    return block+TSIZE;
+}
+
+/**********************************************************
+ * bin_fit
+ * Pick a block of at least asize bytes from one bin
+ * according to FIT_POLICY. A list bin is walked until
+ * FIT_PROBES blocks that fit have been seen or one fits
+ * exactly, and the smallest of them wins. The large bin is
+ * searched through its treap instead, which always yields
+ * the best fit.
+ *
+ * @return void * the block's header, or NULL if none fits
+ **********************************************************/
+static void * bin_fit(arena_t * arena, size_t index, size_t asize)
+{
+    if (index == LARGE_BIN)
+    {
+        return tree_best_fit(arena->large_tree, asize);
+    }
+
+    void * best = NULL;
+    size_t probes = 0;
+    void * list_itr;
+
+    for (list_itr = arena->segList[index]; list_itr != NULL; list_itr = (void *)GET_PRED_PTR(list_itr))
+    {
+        size_t size = GET_SIZE(list_itr);
+        PROFILE_NODE();
+        if (size < asize)
+        {
+            continue;
+        }
+        if (best == NULL || size < GET_SIZE(best))
+        {
+            best = list_itr;
+        }
+        if (size == asize || ++probes >= FIT_PROBES)
+        {
+            break;
+        }
+    }
+    return best;
+}
+
+/**********************************************************
+ * find_fit
+ * Traverse the heap searching for a block to fit asize
+ * Return NULL if no free blocks can handle that size
+ * Assumed that asize is aligned
+ *
+ * Only the bin asize hashes to can hold blocks that are too
+ * small. If none of its blocks fits, every block in a higher
+ * bin does, so the first non-empty one is found straight from
+ * the bitmap. The block taken from a bin is chosen by bin_fit.
+ * The half that remains free after the split is added to the
+ * correct size class in the segregated list.
+ **********************************************************/
+void * find_fit(arena_t * arena, size_t asize)
+{
+    PROFILE_SCOPE(PROF_FIND_FIT);
+    size_t index = map_size_class(asize);
+    void * bp = bin_fit(arena, index, asize);
+
+    if (bp != NULL)
+    {
+        STAT_ADD(arena->stats.allocs[index], 1);
+        return break_block_and_return_bp(arena, bp, asize);
+    }
+
+    size_t word = BINMAP_WORD(index + 1);
+    unsigned long larger_bins = 0;
+    if (word < BINMAP_WORDS)
+    {
+        larger_bins = arena->binmap[word] & (~0UL << ((index + 1) % BINMAP_BITS));
+    }
+    while (!larger_bins && ++word < BINMAP_WORDS)
+    {
+        larger_bins = arena->binmap[word];
+    }
+
+    if (larger_bins)
+    {
+        index = word * BINMAP_BITS + __builtin_ctzl(larger_bins);
+        STAT_ADD(arena->stats.allocs[index], 1);
+        return break_block_and_return_bp(arena, bin_fit(arena, index, asize), asize);
+    }
+
+    return NULL;
+}
+
+/**********************************************************
+ * place
+ * Mark the block as allocated. Allocated blocks have no
+ * footer; the next block's prev-alloc bit records the
+ * change instead.
+ **********************************************************/
+void place(void* bp, size_t asize)
+{
+    PUT(HDRP(bp), GET(HDRP(bp)) | 1);
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+}
+
+/**********************************************************
+ * malloc_fit
+ * Allocate a block of asize bytes from the quick lists or
+ * the segregated list. If no free block fits at first, the
+ * remote-free stack is drained and the quick lists are
+ * consolidated before searching again.
+ * The caller must hold the arena lock.
+ *
+ * @return void * the block, or NULL if no free block fits
+ **********************************************************/
+static void * malloc_fit(arena_t * arena, size_t asize)
+{
+    char * bp;
+
+    /* A parked block of the exact size is still allocated, hand it straight back */
+    if (IS_QUICK_SIZE(asize) && (bp = arena->quick[QUICK_INDEX(asize)]) != NULL)
+    {
+        arena->quick[QUICK_INDEX(asize)] = TCACHE_NEXT(bp);
+        arena->quick_bytes -= asize;
+        return bp;
+    }
+
+    /* Search the free list for a fit. On a miss, take in the blocks other threads
+     * freed and coalesce the parked ones, then search again */
+    if ((bp = find_fit(arena, asize)) == NULL && (REMOTE_PENDING(arena) || arena->quick_bytes != 0))
+    {
+        remote_drain(arena);
+        quick_consolidate(arena);
+        bp = find_fit(arena, asize);
+    }
+    if (bp != NULL) {
+        place(bp, asize);
+        return bp;
+    }
+    return NULL;
+}
+
+/**********************************************************
+ * malloc_top
+ * Carve a block of asize bytes off the top chunk, extending
+ * the heap when the top chunk is too small. If zero is not
+ * NULL, it is set to the start of the payload's tail that
+ * is known to be zero, or the payload's end.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static void * malloc_top(arena_t * arena, size_t asize, char ** zero)
+{
+    if ((arena->top == NULL || GET_SIZE(HDRP(arena->top)) < asize) && extend_heap(arena, asize) == NULL)
+        return NULL;
+
+    char * top_zero = arena->top_zero;
+    char * bp = carve_top(arena, asize);
+    STAT_ADD(arena->stats.top_allocs, 1);
+    place(bp, asize);
+
+    if (zero != NULL)
+    {
+        char * end = bp + GET_SIZE(HDRP(bp)) - TSIZE;
+        // Taking the whole top chunk takes its footer along, which lies in the zero tail
+        if (arena->top == NULL && top_zero < end)
+        {
+            PUT(end - TSIZE, 0);
+        }
+        *zero = MIN(MAX(top_zero, bp), end);
+    }
+    return bp;
+}
+
+/**********************************************************
+ * malloc_block
+ * Allocate a block of asize bytes from the quick lists or
+ * the segregated list, or carve it off the top chunk if no
+ * free block fits even after consolidating the quick lists,
+ * extending the heap when the top chunk is too small.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static void * malloc_block(arena_t * arena, size_t asize)
+{
+    char * bp = malloc_fit(arena, asize);
+    return bp != NULL ? bp : malloc_top(arena, asize, NULL);
+}
+
+/**********************************************************
+ * calloc_block
+ * malloc_block for mm_calloc. zero is set to the start of
+ * the payload's tail that is known to be zero already,
+ * which only a block carved off the top chunk can have.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static void * calloc_block(arena_t * arena, size_t asize, char ** zero)
+{
+    char * bp = malloc_fit(arena, asize);
+    if (bp != NULL)
+    {
+        *zero = bp + GET_SIZE(HDRP(bp)) - TSIZE;
+        return bp;
+    }
+    return malloc_top(arena, asize, zero);
+}
+
+/**********************************************************
+ * memalign_block
+ * Allocate a block of asize bytes whose payload is aligned
+ * to alignment bytes. A block with enough slack for any
+ * payload position is allocated, the leading fragment in
+ * front of the aligned payload is freed on its own and the
+ * trailing one is split off, so both go back to the
+ * segregated list or the top chunk. The leading fragment
+ * is never smaller than a minimum block.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static void * memalign_block(arena_t * arena, size_t alignment, size_t asize)
+{
+    char * bp = malloc_block(arena, asize + alignment + MIN_BLOCK);
+    if (bp == NULL)
+    {
+        return NULL;
+    }
+
+    char * aligned = (char *)(((uintptr_t)bp + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (aligned != bp && (size_t)(aligned - bp) < MIN_BLOCK)
+    {
+        aligned += alignment;
+    }
+
+    if (aligned != bp)
+    {
+        size_t size = GET_SIZE(HDRP(bp));
+        size_t lead = aligned - bp;
+        PUT(HDRP(bp), PACK(lead, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        PUT(HDRP(aligned), PACK(size - lead, 1 | PREV_ALLOC));
+        STAT_ADD(arena->stats.splits, 1);
+        free_block(arena, bp);
+    }
+    shrink_block(arena, aligned, asize);
+    return aligned;
+}
+
+/**********************************************************
+ * free_block
+ * Mark the block as free, coalesce it with neighbouring
+ * blocks and add it to the segregated list. A block that
+ * ends up next to the epilogue becomes the top chunk instead.
+ * Pages of large free blocks are released to the OS.
+ * The caller must hold the lock of the owning arena.
+ **********************************************************/
+static void free_block(arena_t * arena, void *bp)
+{
+    char * freed = bp;
+    size_t size = GET_SIZE(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size,0));
+    CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    bp = coalesce(arena, bp);
+
+    if (HDRP(NEXT_BLKP(bp)) == arena->epilogue_ptr)
+    {
+        arena->top = bp;
+        trim_top(arena, TOP_TRIM_THRESHOLD);
+        return;
+    }
+
+    // Only the pages just freed can still be resident, the neighbours had their chance when they were freed
+    if (GET_SIZE(HDRP(bp)) >= TRIM_BLOCK_THRESHOLD)
+    {
+        release_block_pages(bp, freed, freed + size);
+    }
+    insert_free_block(arena, HDRP(bp));
+}
+
+/**********************************************************
+ * tcache_thread_exit
+ * pthread key destructor. Hands every block left in the
+ * exiting thread's cache back to the segregated list.
+ **********************************************************/
+static void tcache_thread_exit(void *arg)
+{
+    (void)arg;
+    size_t index;
+
+    if (tcache.generation != heap_generation)
+    {
+        return;
+    }
+
+    for (index = 0; index < TCACHE_BINS; index++)
+    {
+        if (tcache.counts[index])
+        {
+            tcache_flush(index, tcache.counts[index]);
+        }
+    }
+}
+
+static void tcache_key_create(void)
+{
+    pthread_key_create(&tcache_key, tcache_thread_exit);
+}
+
+/**********************************************************
+ * tcache_get
+ * Return the calling thread's cache, emptying it if it
+ * still holds blocks from before the last mm_init.
+ **********************************************************/
+static inline tcache_t * tcache_get(void)
+{
+    if (tcache.generation != heap_generation)
+    {
+        memset(tcache.bins, 0, sizeof(tcache.bins));
+        memset(tcache.counts, 0, sizeof(tcache.counts));
+        tcache.generation = heap_generation;
+        tcache.arena = NULL;
+
+        // Register once so the cache is flushed when the thread exits
+        if (!tcache.registered)
+        {
+            pthread_once(&tcache_key_once, tcache_key_create);
+            pthread_setspecific(tcache_key, &tcache);
+            tcache.registered = true;
+        }
+    }
+    return &tcache;
+}
+
+/**********************************************************
+ * arena_lock_for_thread
+ * Lock the arena the calling thread allocates from. If it
+ * is busy, the thread migrates to the first idle arena it
+ * finds and only blocks when every arena is contended.
+ *
+ * @return arena_t * the locked arena
+ *
+ **********************************************************/
+static arena_t * arena_lock_for_thread(void)
+{
+    tcache_t * tc = tcache_get();
+    size_t index;
+
+    if (tc->arena == NULL)
+    {
+        tc->arena = arena_assign();
+    }
+
+    if (pthread_mutex_trylock(&tc->arena->lock) == 0)
+    {
+        return tc->arena;
+    }
+
+    for (index = 0; index < NUM_ARENAS; index++)
+    {
+        arena_t * arena = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+        if (arena != NULL && arena != tc->arena && pthread_mutex_trylock(&arena->lock) == 0)
+        {
+            tc->arena = arena;
+            return arena;
+        }
+    }
+
+    pthread_mutex_lock(&tc->arena->lock);
+    return tc->arena;
+}
+
+/**********************************************************
+ * arena_block
+ * Allocate a block from one arena with the allocator the
+ * request needs: memalign_block for alignments beyond
+ * DSIZE, calloc_block if the caller wants to know which
+ * part is zero already, malloc_block otherwise.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static inline void * arena_block(arena_t * arena, size_t asize, size_t alignment, char ** zero)
+{
+    if (alignment > DSIZE)
+        return memalign_block(arena, alignment, asize);
+    if (zero != NULL)
+        return calloc_block(arena, asize, zero);
+    return malloc_block(arena, asize);
+}
+
+/**********************************************************
+ * arena_malloc
+ * Allocate asize bytes from the calling thread's arena. If
+ * that arena has run out of address space, try the others.
+ * alignment and zero are passed on to arena_block.
+ **********************************************************/
+static void * arena_malloc(size_t asize, size_t alignment, char ** zero)
+{
+    arena_t * arena = arena_lock_for_thread();
+    void * bp = arena_block(arena, asize, alignment, zero);
+    pthread_mutex_unlock(&arena->lock);
+
+    size_t index;
+    for (index = 0; bp == NULL && index < NUM_ARENAS; index++)
+    {
+        arena_t * other = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+        if (other != NULL && other != arena)
+        {
+            pthread_mutex_lock(&other->lock);
+            bp = arena_block(other, asize, alignment, zero);
+            pthread_mutex_unlock(&other->lock);
+        }
+    }
+    return bp;
+}
+
+/**********************************************************
+ * sort_addresses
+ * Sort an array of pointers by address with heapsort. qsort
+ * is not used because it may call malloc for its scratch
+ * space, which is this allocator once it is preloaded, and
+ * the callers can hold an arena lock.
+ **********************************************************/
+static void sort_addresses(void ** ptrs, size_t n)
+{
+    size_t start = n / 2;
+    size_t end = n;
+
+    while (end > 1)
+    {
+        // First build the max-heap, then move its root behind the shrinking heap
+        if (start > 0)
+        {
+            start--;
+        }
+        else
+        {
+            end--;
+            void * tmp = ptrs[0];
+            ptrs[0] = ptrs[end];
+            ptrs[end] = tmp;
+        }
+
+        size_t root = start;
+        size_t child;
+        while ((child = 2 * root + 1) < end)
+        {
+            if (child + 1 < end && (uintptr_t)ptrs[child] < (uintptr_t)ptrs[child + 1])
+            {
+                child++;
+            }
+            if ((uintptr_t)ptrs[root] >= (uintptr_t)ptrs[child])
+            {
+                break;
+            }
+            void * tmp = ptrs[root];
+            ptrs[root] = ptrs[child];
+            ptrs[child] = tmp;
+            root = child;
+        }
+    }
+}
+
+/**********************************************************
+ * free_adjacent_run
+ * Free blocks[0] together with the blocks of the address
+ * sorted array that directly follow it in the heap. The run
+ * is merged into one block first, so it is coalesced with
+ * its neighbours and inserted into the segregated list only
+ * once. None of the blocks may be a slab slot.
+ * The caller must hold the arena lock.
+ *
+ * @return size_t the number of blocks freed
+ **********************************************************/
+static size_t free_adjacent_run(arena_t * arena, void ** blocks, size_t n)
+{
+    char * bp = blocks[0];
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t count = 1;
+
+    while (count < n && blocks[count] == bp + size)
+    {
+        CHECK_CURSOR_ABSORB(arena, blocks[count], bp);
+        size += GET_SIZE(HDRP(blocks[count]));
+        count++;
+    }
+    PUT(HDRP(bp), PACK(size, 1 | GET_PREV_ALLOC(HDRP(bp))));
+    free_block(arena, bp);
+    return count;
+}
+
+/**********************************************************
+ * quick_free
+ * Defer the coalescing of a freed block by parking it,
+ * still marked allocated, in the arena's quick list of its
+ * size. Once QUICK_CONSOLIDATE_BYTES are parked, all quick
+ * lists are consolidated.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static void quick_free(arena_t * arena, void * bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t index = QUICK_INDEX(size);
+
+    SET_TCACHE_NEXT(bp, arena->quick[index]);
+    arena->quick[index] = bp;
+    arena->quick_bytes += size;
+
+    if (arena->quick_bytes >= QUICK_CONSOLIDATE_BYTES)
+    {
+        quick_consolidate(arena);
+    }
+}
+
+/**********************************************************
+ * quick_consolidate
+ * Empty the arena's quick lists and free their blocks for
+ * real. The blocks are sorted by address first, so runs of
+ * neighbours are merged in one step instead of pairwise.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static void quick_consolidate(arena_t * arena)
+{
+    void * blocks[QUICK_CONSOLIDATE_MAX];
+    size_t count = 0;
+    size_t index;
+
+    if (arena->quick_bytes == 0)
+    {
+        return;
+    }
+
+    for (index = 0; index < QUICK_BINS; index++)
+    {
+        void * bp;
+        for (bp = arena->quick[index]; bp != NULL; bp = TCACHE_NEXT(bp))
+        {
+            blocks[count++] = bp;
+        }
+        arena->quick[index] = NULL;
+    }
+    arena->quick_bytes = 0;
+
+    sort_addresses(blocks, count);
+    for (index = 0; index < count; )
+    {
+        index += free_adjacent_run(arena, blocks + index, count - index);
+    }
+}
+
+/**********************************************************
+ * remote_free
+ * Push a block freed by a thread that does not allocate
+ * from its arena onto the arena's remote-free stack. The
+ * block stays marked allocated and is chained through its
+ * first payload word. The owner detaches the whole stack at
+ * once, so pushes cannot suffer from ABA.
+ **********************************************************/
+static void remote_free(arena_t * arena, void * bp)
+{
+    void * head = __atomic_load_n(&arena->remote_free, __ATOMIC_RELAXED);
+    do
+    {
+        SET_TCACHE_NEXT(bp, head);
+    } while (!__atomic_compare_exchange_n(&arena->remote_free, &head, bp, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**********************************************************
+ * remote_drain
+ * Detach the arena's remote-free stack and free its blocks
+ * the way mm_free would have: slab slots go back to their
+ * runs and medium blocks to the quick lists. The other
+ * heap blocks are sorted in batches, so runs of neighbours
+ * are coalesced and inserted into the segregated list as
+ * one.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static void remote_drain(arena_t * arena)
+{
+    if (!REMOTE_PENDING(arena))
+    {
+        return;
+    }
+
+    void * bp = __atomic_exchange_n(&arena->remote_free, NULL, __ATOMIC_ACQUIRE);
+    void * blocks[REMOTE_DRAIN_BATCH];
+    size_t count = 0;
+    size_t index;
+
+    while (bp != NULL)
+    {
+        void * next = TCACHE_NEXT(bp);
+
+        if (IS_SLAB_PTR(bp))
+            slab_free(arena, bp);
+        else if (IS_QUICK_SIZE(GET_SIZE(HDRP(bp))))
+            quick_free(arena, bp);
+        else
+            blocks[count++] = bp;
+
+        // Blocks further down the stack are still allocated, so freeing a batch never merges into them
+        if (count == REMOTE_DRAIN_BATCH || (next == NULL && count != 0))
+        {
+            sort_addresses(blocks, count);
+            for (index = 0; index < count; )
+            {
+                index += free_adjacent_run(arena, blocks + index, count - index);
+            }
+            count = 0;
+        }
+        bp = next;
+    }
+}
+
+/**********************************************************
+ * carve_batch
+ * Split an allocated block of at least count * asize bytes
+ * into count allocated blocks of asize and store them in
+ * out. The last block keeps whatever slack the fit left
+ * over. The caller must hold the arena lock.
+ **********************************************************/
+static void carve_batch(char * bp, size_t asize, size_t count, void ** out)
+{
+    size_t remaining = GET_SIZE(HDRP(bp));
+    size_t itr;
+
+    for (itr = 0; itr + 1 < count; itr++)
+    {
+        PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        remaining -= asize;
+        out[itr] = bp;
+
+        bp += asize;
+        PUT(HDRP(bp), PACK(remaining, 1 | PREV_ALLOC));
+    }
+    out[itr] = bp;
+}
+
+/**********************************************************
+ * tcache_refill
+ * Carve a batch of asize blocks out of a single free block
+ * (or heap extension) and stash all but one of them in the
+ * thread cache.
+ *
+ * @param asize - the adjusted block size of the bin
+ *
+ * @return void * the block handed back to the caller, or
+ *                NULL if the heap is exhausted
+ *
+ **********************************************************/
+static void * tcache_refill(size_t asize)
+{
+    size_t index = TCACHE_INDEX(asize);
+    size_t count = TCACHE_BATCH;
+    arena_t * arena = arena_lock_for_thread();
+    char * bp;
+
+    bp = malloc_block(arena, asize * count);
+    if (bp == NULL)
+    {
+        // Not enough room for a whole batch, settle for one block
+        pthread_mutex_unlock(&arena->lock);
+        return arena_malloc(asize, DSIZE, NULL);
+    }
+
+    void * blocks[TCACHE_BATCH];
+    carve_batch(bp, asize, count, blocks);
+    pthread_mutex_unlock(&arena->lock);
+
+    while (--count > 0)
+    {
+        SET_TCACHE_NEXT(blocks[count - 1], tcache.bins[index]);
+        tcache.bins[index] = blocks[count - 1];
+        tcache.counts[index]++;
+    }
+    return blocks[TCACHE_BATCH - 1];
+}
+
+/**********************************************************
+ * tcache_refill_slab
+ * Take a batch of slots of a slab class from the thread's
+ * arena and stash all but one of them in the thread cache.
+ * Falls back to a boundary-tag block if the slab region is
+ * exhausted.
+ *
+ * @param slab_class - the slab class of the bin
+ *
+ * @return void * the slot handed back to the caller
+ *
+ **********************************************************/
+static void * tcache_refill_slab(size_t slab_class)
+{
+    arena_t * arena = arena_lock_for_thread();
+    if (arena->slab_runs[slab_class] == NULL)
+    {
+        // Slots other threads returned may spare a new run
+        remote_drain(arena);
+    }
+    void * bp = slab_alloc(arena, slab_class);
+    size_t count;
+
+    for (count = 1; bp != NULL && count < TCACHE_BATCH; count++)
+    {
+        void * slot = slab_alloc(arena, slab_class);
+        if (slot == NULL)
+        {
+            break;
+        }
+        SET_TCACHE_NEXT(slot, tcache.bins[slab_class]);
+        tcache.bins[slab_class] = slot;
+        tcache.counts[slab_class]++;
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+
+    if (bp == NULL)
+    {
+        return arena_malloc(ADJUST_SIZE(SLAB_SLOT_SIZE(slab_class)), DSIZE, NULL);
+    }
+    return bp;
+}
+
+/**********************************************************
+ * tcache_flush
+ * Return up to count blocks from a thread cache bin to the
+ * segregated lists (or slab runs) of their arenas. Runs of
+ * blocks owned by the same arena share a single lock
+ * acquisition. Blocks of arenas other than the thread's own
+ * go onto their remote-free stacks instead.
+ **********************************************************/
+static void tcache_flush(size_t index, size_t count)
+{
+    arena_t * locked = NULL;
+
+    while (count-- && tcache.bins[index] != NULL)
+    {
+        void * bp = tcache.bins[index];
+        tcache.bins[index] = TCACHE_NEXT(bp);
+        tcache.counts[index]--;
+
+        arena_t * arena = arena_for_block(bp);
+        if (REMOTE_FREE && arena != tcache.arena)
+        {
+            remote_free(arena, bp);
+            continue;
+        }
+        if (arena != locked)
+        {
+            if (locked != NULL)
+            {
+                pthread_mutex_unlock(&locked->lock);
+            }
+            pthread_mutex_lock(&arena->lock);
+            locked = arena;
+        }
+
+        if (IS_SLAB_PTR(bp))
+            slab_free(arena, bp);
+        else
+            free_block(arena, bp);
+    }
+
+    if (locked != NULL)
+    {
+        pthread_mutex_unlock(&locked->lock);
+    }
+}
+
+/**********************************************************
+ * tcache_put
+ * Park a freed block in a bin of the calling thread's
+ * cache, flushing a batch of the bin once it fills up.
+ * A block may be larger than the blocks its bin is for,
+ * it then serves a smaller request than it could.
+ **********************************************************/
+static inline void tcache_put(size_t index, void * bp)
+{
+    tcache_t * tc = tcache_get();
+    SET_TCACHE_NEXT(bp, tc->bins[index]);
+    tc->bins[index] = bp;
+    if (++tc->counts[index] >= TCACHE_FILL_COUNT)
+    {
+        tcache_flush(index, TCACHE_BATCH);
+    }
+}
+
+/**********************************************************
+ * mm_free
+ * Free the block and coalesce with neighbouring blocks.
+ * Small blocks and slab slots are parked in the thread cache
+ * instead and only reach the segregated list or their slab
+ * run when their bin overflows. Medium blocks are parked in
+ * the arena's quick lists and coalesced in batches. Blocks of
+ * another thread's arena are pushed onto its remote-free
+ * stack without taking its lock.
+ **********************************************************/
+void mm_free(void *bp)
+{
+    PROFILE_SCOPE(PROF_FREE);
+
+    if(bp == NULL){
+      return;
+    }
+
+    size_t size;
+    size_t index;
+    if (IS_SLAB_PTR(bp))
+    {
+        index = SLAB_CLASS(SLAB_RUN(bp)->slot_size);
+    }
+    else if ((size = GET_SIZE(HDRP(bp))) <= TCACHE_MAX_SIZE)
+    {
+        index = TCACHE_INDEX(size);
+    }
+    else if (IS_MMAPPED(HDRP(bp)))
+    {
+        mmap_free(bp);
+        return;
+    }
+    else
+    {
+        arena_t * arena = arena_for_block(bp);
+        if (REMOTE_FREE && arena != tcache_get()->arena)
+        {
+            remote_free(arena, bp);
+            return;
+        }
+        pthread_mutex_lock(&arena->lock);
+        if (IS_QUICK_SIZE(size))
+            quick_free(arena, bp);
+        else
+            free_block(arena, bp);
+        pthread_mutex_unlock(&arena->lock);
+        return;
+    }
+
+    tcache_put(index, bp);
+}
+
+/**********************************************************
+ * mm_free_sized
+ * mm_free for callers that know the size a block was
+ * allocated with, like C++ sized deallocation. The thread
+ * cache bin is picked from size alone, so a small block or
+ * slab slot is cached without reading its header or run
+ * header. Small blocks never have a mapping of their own,
+ * mm_realloc moves a mapped block to the heap when it
+ * shrinks below the mmap threshold. Other blocks go
+ * through mm_free, as whether they got a mapping of their
+ * own depends on the mmap threshold at the time they were
+ * allocated.
+ *
+ * @param size - the size passed to mm_malloc, or to the
+ *               mm_realloc that last resized the block
+ **********************************************************/
+void mm_free_sized(void * bp, size_t size)
+{
+    size_t index;
+
+    if (bp == NULL)
+    {
+        return;
+    }
+
+    // Slab sizes fall back to the heap when the slab region is exhausted
+    if (size != 0 && size <= SLAB_MAX_SIZE && IS_SLAB_PTR(bp))
+    {
+        index = SLAB_CLASS(size);
+    }
+    else if (size > SLAB_MAX_SIZE && ADJUST_SIZE(size) <= TCACHE_MAX_SIZE)
+    {
+        index = TCACHE_INDEX(ADJUST_SIZE(size));
+    }
+    else
+    {
+        mm_free(bp);
+        return;
+    }
+
+    PROFILE_SCOPE(PROF_FREE);
+    tcache_put(index, bp);
+}
+
+
+/**********************************************************
+ * mm_malloc
+ * Allocate a block of size bytes.
+ * Small sizes are served from the thread cache first, and
+ * the smallest ones are backed by slab runs rather than
+ * the boundary-tag heap. Sizes from mmap_threshold up get
+ * a mapping of their own.
+ * The type of search is determined by find_fit
+ * The decision of splitting the block, or not is determined
+ *   in place(..)
+ * If no block satisfies the request, the heap is extended
+ **********************************************************/
+void *mm_malloc(size_t size)
+{
+    PROFILE_SCOPE(PROF_MALLOC);
+    size_t asize; /* adjusted block size */
+    char * bp;
+
+    /* Ignore spurious requests */
+    if (size == 0)
+        return NULL;
+
+    if (size <= SLAB_MAX_SIZE)
+    {
+        tcache_t * tc = tcache_get();
+        size_t slab_class = SLAB_CLASS(size);
+
+        if ((bp = tc->bins[slab_class]) != NULL)
+        {
+            tc->bins[slab_class] = TCACHE_NEXT(bp);
+            tc->counts[slab_class]--;
+            return bp;
+        }
+        return tcache_refill_slab(slab_class);
+    }
+
+    /* Adjust block size to include overhead and alignment reqs. */
+    asize = ADJUST_SIZE(size);
+
+    if (asize <= TCACHE_MAX_SIZE)
+    {
+        tcache_t * tc = tcache_get();
+        size_t index = TCACHE_INDEX(asize);
+
+        if ((bp = tc->bins[index]) != NULL)
+        {
+            tc->bins[index] = TCACHE_NEXT(bp);
+            tc->counts[index]--;
+            return bp;
+        }
+        return tcache_refill(asize);
+    }
+
+    if (asize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        return mmap_alloc(size, DSIZE);
+    }
+
+    return arena_malloc(asize, DSIZE, NULL);
+}
+
+/**********************************************************
+ * mm_memalign
+ * Allocate a block of size bytes whose payload starts at a
+ * multiple of alignment, which must be a power of two.
+ * Alignments up to DSIZE are what mm_malloc guarantees
+ * anyway. Larger ones are carved out of an arena block
+ * with the fragments around the payload freed again, or
+ * get an aligned mapping of their own once the padded size
+ * reaches the mmap threshold. The result is an ordinary
+ * block as far as mm_free and mm_realloc are concerned;
+ * mm_realloc does not keep the alignment if it moves it.
+ *
+ * @return void * the payload, or NULL if alignment is not
+ *                a power of two or memory ran out
+ **********************************************************/
+void * mm_memalign(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return NULL;
+    }
+    if (alignment <= DSIZE)
+    {
+        return mm_malloc(size);
+    }
+
+    PROFILE_SCOPE(PROF_MALLOC);
+    if (size == 0 || size > SIZE_MAX - alignment - page_size)
+    {
+        return NULL;
+    }
+
+    size_t asize = ADJUST_SIZE(size);
+    if (asize + alignment >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        return mmap_alloc(size, alignment);
+    }
+
+    return arena_malloc(asize, alignment, NULL);
+}
+
+/**********************************************************
+ * mm_posix_memalign
+ * posix_memalign on top of mm_memalign. The alignment must
+ * also be a multiple of sizeof(void *).
+ *
+ * @return int - 0 on success, EINVAL for a bad alignment,
+ *               ENOMEM if memory ran out
+ **********************************************************/
+int mm_posix_memalign(void ** memptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+    {
+        return EINVAL;
+    }
+
+    void * bp = mm_memalign(alignment, size);
+    if (bp == NULL && size != 0)
+    {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+/**********************************************************
+ * mm_aligned_alloc
+ * C11 aligned_alloc on top of mm_memalign. Like glibc, a
+ * size that is not a multiple of alignment is accepted.
+ **********************************************************/
+void * mm_aligned_alloc(size_t alignment, size_t size)
+{
+    return mm_memalign(alignment, size);
+}
+
+/**********************************************************
+ * zero_payload
+ * Clear size bytes at bp, which is DSIZE aligned. From
+ * CALLOC_STREAM_THRESHOLD bytes up the bulk is cleared with
+ * non-temporal stores where the machine has them, so a
+ * large buffer does not evict the working set from the
+ * caches on its way to memory. Smaller sizes go to memset,
+ * which clears with the widest stores available.
+ **********************************************************/
+static void zero_payload(void * bp, size_t size)
+{
+#ifdef __SSE2__
+    if (size >= CALLOC_STREAM_THRESHOLD)
+    {
+        __m128i zero = _mm_setzero_si128();
+        char * p = bp;
+        char * end = p + (size & ~(size_t)63);
+
+        for (; p < end; p += 64)
+        {
+            _mm_stream_si128((__m128i *)p, zero);
+            _mm_stream_si128((__m128i *)(p + 16), zero);
+            _mm_stream_si128((__m128i *)(p + 32), zero);
+            _mm_stream_si128((__m128i *)(p + 48), zero);
+        }
+        _mm_sfence();
+        memset(end, 0, size & 63);
+        return;
+    }
+#endif
+    memset(bp, 0, size);
+}
+
+/**********************************************************
+ * mm_calloc
+ * Allocate a zeroed array of nmemb elements of size bytes.
+ * Only what is not known to be zero is cleared: a mapping
+ * of its own is zero already, and so is the tail of a block
+ * carved off the top chunk that came straight from the OS
+ * or had its pages released. Small blocks come from the
+ * caches and slabs with no such history and are cheap to
+ * clear in full.
+ *
+ * @return void * the payload, or NULL if nmemb * size
+ *                overflows or memory ran out
+ **********************************************************/
+void * mm_calloc(size_t nmemb, size_t size)
+{
+    char * bp;
+
+    if (nmemb != 0 && size > SIZE_MAX / nmemb)
+    {
+        return NULL;
+    }
+
+    size_t bytes = nmemb * size;
+    if (bytes == 0 || bytes > SIZE_MAX - page_size - DSIZE)
+    {
+        return NULL;
+    }
+
+    size_t asize = ADJUST_SIZE(bytes);
+    if (bytes <= SLAB_MAX_SIZE || asize <= TCACHE_MAX_SIZE)
+    {
+        if ((bp = mm_malloc(bytes)) != NULL)
+            memset(bp, 0, bytes);
+        return bp;
+    }
+
+    PROFILE_SCOPE(PROF_MALLOC);
+
+    if (asize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        return mmap_alloc(bytes, DSIZE);
+    }
+
+    char * zero;
+    if ((bp = arena_malloc(asize, DSIZE, &zero)) != NULL)
+    {
+        zero_payload(bp, MIN((size_t)(zero - bp), bytes));
+    }
+    return bp;
+}
+
+/**********************************************************
+ * mm_usable_size
+ * Return the number of payload bytes the block at ptr can
+ * hold, which may be more than was asked for.
+ **********************************************************/
+size_t mm_usable_size(void * ptr)
+{
+    if (ptr == NULL)
+    {
+        return 0;
+    }
+    if (IS_SLAB_PTR(ptr))
+    {
+        return SLAB_RUN(ptr)->slot_size;
+    }
+    if (IS_MMAPPED(HDRP(ptr)))
+    {
+        return MMAP_LENGTH(ptr) - GET_WORD(MMAP_OFFSET_PTR(ptr));
+    }
+    return GET_SIZE(HDRP(ptr)) - TSIZE;
+}
+
+/**********************************************************
+ * shrink_block
+ * Split the tail off an allocated block so that only asize
+ * bytes remain allocated. The tail is freed, coalescing it
+ * with the next block if that one is free. Tails smaller
+ * than a minimum block stay with the allocation.
+ * The caller must hold the arena lock.
+ **********************************************************/
+static void shrink_block(arena_t * arena, void * bp, size_t asize)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (size - asize < MIN_BLOCK)
+    {
+        return;
+    }
+
+    PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(size - asize, 1 | PREV_ALLOC));
+    STAT_ADD(arena->stats.splits, 1);
+    free_block(arena, NEXT_BLKP(bp));
+}
+
+/**********************************************************
+ * grow_block
+ * Try to grow an allocated block to asize bytes without
+ * moving it, either by absorbing the free block after it
+ * or, when the block is the last one in the heap, by
+ * taking just enough of the top chunk. Any slack beyond
+ * asize is split back off.
+ * The caller must hold the arena lock.
+ *
+ * @return bool - true if the block now holds asize bytes
+ *
+ **********************************************************/
+static bool grow_block(arena_t * arena, void * bp, size_t asize)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    void * next = NEXT_BLKP(bp);
+    size_t next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+
+    if (next == arena->top || HDRP(next) == arena->epilogue_ptr)
+    {
+        // The last block takes only what it needs from the top chunk, extending the heap if necessary
+        size_t needed = asize - size;
+        if ((arena->top == NULL || next_size < needed) && extend_heap(arena, needed) == NULL)
+        {
+            return false;
+        }
+        next_size = GET_SIZE(HDRP(carve_top(arena, needed)));
+    }
+    else if (size + next_size < asize)
+    {
+        return false;
+    }
+    else if (next_size)
+    {
+        remove_free_block(arena, HDRP(next));
+    }
+
+    if (next_size)
+    {
+        CHECK_CURSOR_ABSORB(arena, next, bp);
+        PUT(HDRP(bp), PACK(size + next_size, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+
+    shrink_block(arena, bp, asize);
+    return true;
+}
+
+/**********************************************************
+ * mm_realloc
+ * Shrinks by splitting off the tail of the block and grows
+ * in place when the next block is free or the block is at
+ * the end of the heap. Only falls back to mm_malloc, a copy
+ * and mm_free when neither works, or when the block grows
+ * to the mmap threshold and moves to a mapping of its own.
+ * Blocks with their own mapping are resized with mremap
+ * instead, unless they shrink below the mmap threshold and
+ * move to the heap.
+ *********************************************************/
+void *mm_realloc(void *ptr, size_t size)
+{
+    PROFILE_SCOPE(PROF_REALLOC);
+
+    /* If size == 0 then this is just free, and we return NULL. */
+    if(size == 0)
+    {
+      mm_free(ptr);
+      return NULL;
+    }
+    /* If oldptr is NULL, then this is just malloc. */
+    if (ptr == NULL)
+    {
+      return (mm_malloc(size));
+    }
+
+    /* Slab slots cannot grow, move them once they are too small */
+    if (IS_SLAB_PTR(ptr))
+    {
+        size_t slot_size = SLAB_RUN(ptr)->slot_size;
+        if (size <= slot_size)
+        {
+            return ptr;
+        }
+
+        void * newptr = mm_malloc(size);
+        if (newptr != NULL)
+        {
+            memcpy(newptr, ptr, slot_size);
+            mm_free(ptr);
+        }
+        return newptr;
+    }
+
+    /* Large blocks are resized by remapping their pages, and move to the heap
+     * once they shrink below the mmap threshold, like mm_malloc would place them */
+    if (IS_MMAPPED(HDRP(ptr)))
+    {
+        void * newptr = NULL;
+        if (ADJUST_SIZE(size) >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+        {
+            newptr = mmap_realloc(ptr, size);
+        }
+        if (newptr == NULL && (newptr = mm_malloc(size)) != NULL)
+        {
+            memcpy(newptr, ptr, MIN(size, MMAP_LENGTH(ptr) - GET_WORD(MMAP_OFFSET_PTR(ptr))));
+            mm_free(ptr);
+        }
+        return newptr;
+    }
+
+    void *oldptr = ptr;
+    void *newptr;
+    size_t copySize = GET_SIZE(HDRP(oldptr)) - TSIZE;
+    size_t asize = ADJUST_SIZE(size);
+
+    arena_t * arena = arena_for_block(oldptr);
+    pthread_mutex_lock(&arena->lock);
+    bool resized = true;
+    if (asize <= copySize + TSIZE)
+    {
+        shrink_block(arena, oldptr, asize);
+    }
+    else if (asize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        resized = false;
+    }
+    else
+    {
+        resized = grow_block(arena, oldptr, asize);
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    if (resized)
+    {
+        return oldptr;
+    }
+
+    newptr = mm_malloc(size);
+    if (newptr == NULL)
+    {
+        return NULL;
+    }
+
+    /* Copy the old data. The block is too small for size, so all of its payload is copied */
+    memcpy(newptr, oldptr, copySize);
+    mm_free(oldptr);
+    return newptr;
+}
+
+/**********************************************************
+ * mm_malloc_batch
+ * Allocate up to n blocks of size bytes into out. Blocks
+ * come from the thread cache first. The rest is carved out
+ * of a single free block or heap extension under one
+ * acquisition of the arena lock, so the whole batch costs
+ * one find_fit and one split.
+ *
+ * @return size_t the number of blocks allocated, fewer than
+ *                n only if memory ran out
+ **********************************************************/
+size_t mm_malloc_batch(size_t size, size_t n, void ** out)
+{
+    size_t got = 0;
+
+    if (size == 0 || n == 0)
+        return 0;
+
+    tcache_t * tc = tcache_get();
+    size_t asize = ADJUST_SIZE(size);
+    size_t index = size <= SLAB_MAX_SIZE ? SLAB_CLASS(size) : TCACHE_INDEX(asize);
+
+    /* Drain the thread cache bin first */
+    if (size <= SLAB_MAX_SIZE || asize <= TCACHE_MAX_SIZE)
+    {
+        while (got < n && tc->bins[index] != NULL)
+        {
+            out[got++] = tc->bins[index];
+            tc->bins[index] = TCACHE_NEXT(out[got - 1]);
+            tc->counts[index]--;
+        }
+    }
+
+    if (size > SLAB_MAX_SIZE && asize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        while (got < n && (out[got] = mmap_alloc(size, DSIZE)) != NULL)
+            got++;
+        return got;
+    }
+
+    arena_t * arena = arena_lock_for_thread();
+    if (size <= SLAB_MAX_SIZE)
+    {
+        while (got < n && (out[got] = slab_alloc(arena, index)) != NULL)
+            got++;
+    }
+    else if (got < n)
+    {
+        // One block for the rest of the batch, or one at a time if no single block is that large
+        size_t count = n - got;
+        char * bp = count <= SIZE_MAX / asize ? malloc_block(arena, asize * count) : NULL;
+        if (bp != NULL)
+        {
+            carve_batch(bp, asize, count, out + got);
+            got = n;
+        }
+        while (got < n && (out[got] = malloc_block(arena, asize)) != NULL)
+            got++;
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    // The thread's arena is exhausted, let mm_malloc try the others
+    while (got < n && (out[got] = mm_malloc(size)) != NULL)
+        got++;
+
+    return got;
+}
+
+/**********************************************************
+ * mm_free_batch
+ * Free n blocks. Small blocks are parked in the thread
+ * cache while their bin has room, the others are sorted by
+ * address so that each run of adjacent blocks is merged
+ * into one free block, coalesced and inserted once, with
+ * the arena lock taken once per run of blocks of the same
+ * arena. ptrs may contain NULL and is reordered in place.
+ **********************************************************/
+void mm_free_batch(void ** ptrs, size_t n)
+{
+    tcache_t * tc = tcache_get();
+    arena_t * locked = NULL;
+    size_t heap_blocks = 0;
+    size_t itr;
+
+    /* Move the blocks that do not go back to an arena heap out of the way */
+    for (itr = 0; itr < n; itr++)
+    {
+        void * bp = ptrs[itr];
+        if (bp == NULL)
+            continue;
+
+        size_t index = TCACHE_BINS;
+        if (IS_SLAB_PTR(bp))
+            index = SLAB_CLASS(SLAB_RUN(bp)->slot_size);
+        else if (GET_SIZE(HDRP(bp)) <= TCACHE_MAX_SIZE)
+            index = TCACHE_INDEX(GET_SIZE(HDRP(bp)));
+
+        if (index < TCACHE_BINS && tc->counts[index] + 1 < TCACHE_FILL_COUNT)
+        {
+            SET_TCACHE_NEXT(bp, tc->bins[index]);
+            tc->bins[index] = bp;
+            tc->counts[index]++;
+        }
+        else if (!IS_SLAB_PTR(bp) && IS_MMAPPED(HDRP(bp)))
+        {
+            mmap_free(bp);
+        }
+        else
+        {
+            ptrs[heap_blocks++] = bp;
+        }
+    }
+
+    sort_addresses(ptrs, heap_blocks);
+
+    for (itr = 0; itr < heap_blocks; itr++)
+    {
+        void * bp = ptrs[itr];
+        arena_t * arena = arena_for_block(bp);
+        if (arena != locked)
+        {
+            if (locked != NULL)
+                pthread_mutex_unlock(&locked->lock);
+            pthread_mutex_lock(&arena->lock);
+            locked = arena;
+        }
+
+        if (IS_SLAB_PTR(bp))
+        {
+            slab_free(arena, bp);
+            continue;
+        }
+
+        // Slab slots are never adjacent to heap blocks, so the run stops before any
+        itr += free_adjacent_run(arena, ptrs + itr, heap_blocks - itr) - 1;
+    }
+
+    if (locked != NULL)
+        pthread_mutex_unlock(&locked->lock);
+}
+
+/**********************************************************
+ * check_tree
+ * Walk a treap, counting its nodes. Every node must order
+ * between lo and hi (either may be NULL for no bound), must
+ * not have a higher priority than its parent and must have
+ * been marked by the walk over the large bin's list.
+ *
+ * @return bool - true if the subtree is well formed
+ **********************************************************/
+static bool check_tree(void * node, void * lo, void * hi, size_t * count)
+{
+    if (node == NULL)
+    {
+        return true;
+    }
+
+    (*count)++;
+    if ((lo && !tree_less(lo, node)) || (hi && !tree_less(node, hi)) || !(GET(node) & CHECK_MARK))
+    {
+        return false;
+    }
+
+    void * left = TREE_LEFT(node);
+    void * right = TREE_RIGHT(node);
+    if ((left && TREE_PRIORITY(left) > TREE_PRIORITY(node)) ||
+        (right && TREE_PRIORITY(right) > TREE_PRIORITY(node)))
+    {
+        return false;
+    }
+
+    return check_tree(left, lo, node, count) && check_tree(right, node, hi, count);
+}
+
+/**********************************************************
+ * check_block
+ * Check the invariants of one heap block that can be
+ * verified from the block and its direct neighbours:
+ *  - it is not a free block next to another free block
+ *  - the next header's prev-alloc bit matches it
+ *  - a free block's footer matches its header
+ *  - a free block before the epilogue is the top chunk
+ *  - any other free block is linked both ways into the
+ *    list of the bin its size maps to
+ * The caller must hold the arena lock.
+ *
+ * @return int - 1 if the block is consistent
+ **********************************************************/
+static int check_block(arena_t * arena, void * bp)
+{
+    int result = 1;
+    bool currAlloc = GET_ALLOC(HDRP(bp));
+    void * next_bp = NEXT_BLKP(bp);
+    bool nextAlloc = GET_ALLOC(HDRP(next_bp));
+
+    if(!currAlloc && !nextAlloc)
+    {
+        fprintf(stderr, "[mm_check Error] Two contiguous blocks missed coalescing.\n");
+        result = 0;
+    }
+    if(!GET_PREV_ALLOC(HDRP(next_bp)) != !currAlloc)
+    {
+        fprintf(stderr, "[mm_check Error] Prev-alloc bit does not match the previous block.\n");
+        result = 0;
+    }
+    if(currAlloc)
+    {
+        return result;
+    }
+
+    if(GET(FTRP(bp)) != PACK(GET_SIZE(HDRP(bp)), 0))
+    {
+        fprintf(stderr, "[mm_check Error] Free block footer does not match its header.\n");
+        result = 0;
+    }
+
+    /* The top chunk is the only free block outside the lists */
+    if(HDRP(next_bp) == arena->epilogue_ptr || bp == arena->top)
+    {
+        if(bp != arena->top || HDRP(next_bp) != arena->epilogue_ptr)
+        {
+            fprintf(stderr, "[mm_check Error] Free block before the epilogue is not the top chunk\n");
+            result = 0;
+        }
+        return result;
+    }
+
+    void * header = HDRP(bp);
+    void * next = (void *)GET_PRED_PTR(header);
+    void * prev = (void *)GET_SUCC_PTR(header);
+    size_t index = map_size_class(GET_SIZE(header));
+    if((next && ((void *)GET_SUCC_PTR(next) != header || map_size_class(GET_SIZE(next)) != index)) ||
+       (prev && ((void *)GET_PRED_PTR(prev) != header || map_size_class(GET_SIZE(prev)) != index)) ||
+       (!prev && arena->segList[index] != header))
+    {
+        fprintf(stderr, "[mm_check Error] Free block is not linked into its bin\n");
+        result = 0;
+    }
+    return result;
+}
+
+/**********************************************************
+ * check_arena
+ * Check the consistency of an arena's heap in time linear
+ * in the number of blocks.
+ * Return nonzero if the heap is consistent.
+ * The caller must hold the arena lock.
+ *
+ * Consistency Checks include:
+ * 1) Is every block in the free list marked as free?
+ * 2) Are there any contiguous free blocks that escaped
+ *    coalescing?
+ * 3) Are all blocks marked as free in the heap added
+ *    to the segregated list?
+ * 4) Do all blocks hashing to a certain index in the 
+ *    hash table fit within the correct size class of the
+ *    segregated free list?
+ * 5) Does every slab run with free slots belong to this
+ *    arena and class, and agree with its free bitmap?
+ * 6) Does every header's prev-alloc bit match the block
+ *    before it, and does every free block's footer match
+ *    its header?
+ * 7) Does the large bin's treap hold exactly the blocks of
+ *    its list, in order and with the heap property intact?
+ * 8) Do the free block counters of each bin match its list?
+ * 9) Is every block in the quick lists still allocated, in
+ *    the heap and of its list's size, and do they add up
+ *    to the parked byte count?
+ * 10) Is every block on the remote-free stack an allocated
+ *    block of this arena's heap or one of its slab slots?
+ *
+ * Rather than searching the lists for every free block of
+ * the heap, the list walk sets CHECK_MARK in the header of
+ * every block it visits and the heap walk clears it again.
+ * A free block the heap walk finds unmarked is missing from
+ * the lists, and marks left over afterwards belong to list
+ * entries that are not blocks of this heap.
+ *    
+ *********************************************************/
+static int check_arena(arena_t * arena)
+{
+    int result = 1;
+    size_t itr;
+    size_t marked = 0;
+    size_t listed[HASH_SIZE];
+    void *currNode;
+
+    /* Walk the lists: is every block free, in its size class, counted and on the list only once? */
+    // Example: with 4 sub-bins, blocks in index 1 are between size 33-40 (32<SIZE<=40)
+    for(itr = 0; itr < HASH_SIZE; itr++)
+    {
+        size_t minSize = itr ? size_class_max(itr-1) : 0;
+        size_t maxSize = itr != LARGE_BIN ? size_class_max(itr) : SIZE_MAX;
+        size_t blocks = 0;
+        size_t bytes = 0;
+
+        for(currNode = arena->segList[itr]; currNode; currNode = (void*) GET_PRED_PTR(currNode))
+        {
+            //If a block is allocated in the list, this is an error.
+            if(GET_ALLOC(currNode))
+            {
+                fprintf(stderr, "[mm_check Error] a block in the seglist is still allocated\n");
+                result = 0;
+            }
+            if(GET(currNode) & CHECK_MARK)
+            {
+                fprintf(stderr, "[mm_check Error] a block is on the seglist twice, or the list has a cycle\n");
+                result = 0;
+                break;
+            }
+            // If a block is outside the size class range, it's an error.
+            // The last bucket stores everything larger than the one before it.
+            if(GET_SIZE(currNode) <= minSize || GET_SIZE(currNode) > maxSize)
+            {
+                fprintf(stderr, "[mm_check Error] This block is outside its size class range\n");
+                result = 0;
+            }
+            PUT(currNode, GET(currNode) | CHECK_MARK);
+            marked++;
+            blocks++;
+            bytes += GET_SIZE(currNode);
+        }
+        listed[itr] = blocks;
+
+        /* Do the mm_stats counters agree with the list? */
+        if(blocks != arena->stats.free_blocks[itr] || bytes != arena->stats.free_bytes[itr])
+        {
+            fprintf(stderr, "[mm_check Error] Free block counters of a bin do not match its list\n");
+            result = 0;
+        }
+    }
+
+    /* Does the large bin's treap match its list? Its nodes are distinct and all marked, so equal counts make the sets equal */
+    size_t tree_count = 0;
+    if(!check_tree(arena->large_tree, NULL, NULL, &tree_count))
+    {
+        fprintf(stderr, "[mm_check Error] Large bin treap is out of order or holds an unlisted block\n");
+        result = 0;
+    }
+    if(tree_count != arena->stats.free_blocks[LARGE_BIN])
+    {
+        fprintf(stderr, "[mm_check Error] Large bin treap and list sizes differ\n");
+        result = 0;
+    }
+
+    /* Walk the heap: check every block and clear the marks of listed free blocks */
+    void *itr_pointer = (char *)arena->prologue_ptr + TSIZE;
+    while(itr_pointer != (char *)arena->epilogue_ptr+TSIZE)
+    {
+        result &= check_block(arena, itr_pointer);
+
+        if(!GET_ALLOC(HDRP(itr_pointer)) && itr_pointer != arena->top)
+        {
+            if(GET(HDRP(itr_pointer)) & CHECK_MARK)
+            {
+                PUT(HDRP(itr_pointer), GET(HDRP(itr_pointer)) & ~CHECK_MARK);
+                marked--;
+            }
+            else
+            {
+                fprintf(stderr, "[mm_check Error] Free block is not in segregated list \n");
+                result = 0;
+            }
+        }
+        itr_pointer = NEXT_BLKP(itr_pointer);
+    }
+
+    /* Marks that are left belong to list entries the heap walk never reached */
+    if(marked != 0)
+    {
+        fprintf(stderr, "[mm_check Error] The seglist holds blocks that are not in the heap\n");
+        result = 0;
+        for(itr = 0; itr < HASH_SIZE; itr++)
+        {
+            size_t count;
+            for(currNode = arena->segList[itr], count = 0; count < listed[itr]; currNode = (void*) GET_PRED_PTR(currNode), count++)
+            {
+                PUT(currNode, GET(currNode) & ~CHECK_MARK);
+            }
+        }
+    }
+
+    /* Is the top chunk really the last block, and does its known-zero tail lie inside it? */
+    if(arena->top && (GET_ALLOC(HDRP(arena->top)) || HDRP(NEXT_BLKP(arena->top)) != arena->epilogue_ptr))
+    {
+        fprintf(stderr, "[mm_check Error] Top chunk is not a free block before the epilogue\n");
+        result = 0;
+    }
+    if(arena->top_zero != TOP_ZERO_NONE && (!arena->top || arena->top_zero < (char *)arena->top || arena->top_zero > FTRP(arena->top)))
+    {
+        fprintf(stderr, "[mm_check Error] The zero tail of the top chunk is outside it\n");
+        result = 0;
+    }
+
+    /* Do the blocks other threads freed belong to this arena? Pushes only prepend, so the stack can be walked while they go on */
+    for(currNode = __atomic_load_n(&arena->remote_free, __ATOMIC_ACQUIRE); currNode; currNode = TCACHE_NEXT(currNode))
+    {
+        if(IS_SLAB_PTR(currNode) ? SLAB_RUN(currNode)->arena != arena :
+           (char *)currNode <= (char *)arena->prologue_ptr || (char *)currNode >= (char *)arena->epilogue_ptr || !GET_ALLOC(HDRP(currNode)))
+        {
+            fprintf(stderr, "[mm_check Error] a block on the remote-free stack is free or not this arena's\n");
+            result = 0;
+            break;
+        }
+    }
+
+    /* Are the parked blocks of the quick lists consistent? */
+    size_t quick_bytes = 0;
+    size_t quick_blocks = 0;
+    for(itr = 0; itr < QUICK_BINS; itr++)
+    {
+        for(currNode = arena->quick[itr]; currNode && quick_blocks <= QUICK_CONSOLIDATE_MAX; currNode = TCACHE_NEXT(currNode))
+        {
+            if((char *)currNode <= (char *)arena->prologue_ptr || (char *)currNode >= (char *)arena->epilogue_ptr)
+            {
+                fprintf(stderr, "[mm_check Error] a block in a quick list is outside the heap\n");
+                result = 0;
+                break;
+            }
+            if(!GET_ALLOC(HDRP(currNode)) || QUICK_INDEX(GET_SIZE(HDRP(currNode))) != itr)
+            {
+                fprintf(stderr, "[mm_check Error] a block in a quick list is free or of the wrong size\n");
+                result = 0;
+            }
+            quick_bytes += GET_SIZE(HDRP(currNode));
+            quick_blocks++;
+        }
+    }
+    if(quick_bytes != arena->quick_bytes || quick_blocks > QUICK_CONSOLIDATE_MAX)
+    {
+        fprintf(stderr, "[mm_check Error] the quick lists do not add up to their byte count, or have a cycle\n");
+        result = 0;
+    }
+
+    /* Are the slab runs on the arena's lists consistent? */
+    for(itr = 0; itr < SLAB_CLASSES; itr++)
+    {
+        slab_run_t *run = arena->slab_runs[itr];
+        while(run)
+        {
+            size_t nfree = 0;
+            size_t word;
+            for(word = 0; word < SLAB_FREEMAP_WORDS; word++)
+            {
+                nfree += __builtin_popcountl(run->freemap[word]);
+            }
+            if(run->arena != arena || run->slot_size != SLAB_SLOT_SIZE(itr))
+            {
+                fprintf(stderr, "[mm_check Error] Slab run is on the wrong list\n");
+                result = 0;
+            }
+            if(run->nfree == 0 || run->nfree > run->nslots || nfree != run->nfree)
+            {
+                fprintf(stderr, "[mm_check Error] Slab run free count does not match its bitmap\n");
+                result = 0;
+            }
+            run = run->next;
+        }
+    }
+
+    return result;
+
+}
 
 /**********************************************************
- * break_block_and_return_bp
- * Breaks the block into two segments: one block consisting 
- * of asize bytes and another with a size
- * of original block size minus asize
- *
- * @param block - A pointer to the block
- * @param asize - The size needed from the block
+ * largest_free_block
+ * Find the size of the largest free block of an arena,
+ * which is either the top chunk or in the highest
+ * non-empty bin. The caller must hold the arena lock.
+ **********************************************************/
+static size_t largest_free_block(arena_t * arena)
+{
+    size_t largest = arena->top ? GET_SIZE(HDRP(arena->top)) : 0;
+    ssize_t word;
+
+    for (word = BINMAP_WORDS - 1; word >= 0 && !arena->binmap[word]; word--)
+        ;
+    if (word < 0)
+    {
+        return largest;
+    }
+
+    size_t index = word * BINMAP_BITS + (BINMAP_BITS - 1 - __builtin_clzl(arena->binmap[word]));
+    void * node;
+    if (index == LARGE_BIN)
+    {
+        // The treap's rightmost node is the largest block
+        for (node = arena->large_tree; TREE_RIGHT(node) != NULL; node = TREE_RIGHT(node))
+            ;
+        return MAX(largest, GET_SIZE(node));
+    }
+
+    for (node = arena->segList[index]; node != NULL; node = (void *)GET_PRED_PTR(node))
+    {
+        largest = MAX(largest, GET_SIZE(node));
+    }
+    return largest;
+}
+
+/**********************************************************
+ * mm_stats
+ * Take a snapshot of the allocator's counters, summed over
+ * all arenas. The counters are read with relaxed loads, so
+ * allocating threads are never stopped; each arena's lock
+ * is only taken briefly to size its top chunk and largest
+ * free block. Blocks parked in thread caches or slab runs
+ * count as allocated.
  *
- * @return void * the pointer to the block with size asize
+ * @param stats - filled with the totals
+ * @param bins  - filled with the counters of the first
+ *                nbins size classes, may be NULL
  *
+ * @return size_t - the number of size classes
  **********************************************************/
-void * break_block_and_return_bp(void * block, size_t asize)
+size_t mm_stats(mm_stats_t * stats, mm_bin_stats_t * bins, size_t nbins)
 {
-    size_t block_size = GET_SIZE(block);
-    remove_free_block(block);
+    size_t index;
+    size_t bin;
 
-    size_t fragment_size = block_size - asize;
+    memset(stats, 0, sizeof(*stats));
+    nbins = bins ? MIN(nbins, HASH_SIZE) : 0;
+    for (bin = 0; bin < nbins; bin++)
+    {
+        bins[bin] = (mm_bin_stats_t){ bin != LARGE_BIN ? size_class_max(bin) : 0, 0, 0, 0 };
+    }
 
-    // If fragment is the minimum size of a free block (4 words), break it up
-    if (fragment_size >= WSIZE*4)
+    for (index = 0; index < NUM_ARENAS; index++)
     {
-        // Create a block of asize
-        PUT(block, PACK(asize,0));
-        PUT(block+asize-WSIZE, PACK(asize,0));
+        arena_t * arena = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+        if (arena == NULL)
+        {
+            continue;
+        }
+        arena_stats_t * arena_stats = &arena->stats;
 
-        // Create a block of fragment_size
-        PUT(block+asize, PACK(fragment_size,0));
-        PUT(block+block_size-WSIZE, PACK(fragment_size,0));
+        for (bin = 0; bin < HASH_SIZE; bin++)
+        {
+            size_t free_bytes = STAT_READ(arena_stats->free_bytes[bin]);
+            stats->free_bytes += free_bytes;
+            if (bin < nbins)
+            {
+                bins[bin].free_blocks += STAT_READ(arena_stats->free_blocks[bin]);
+                bins[bin].free_bytes += free_bytes;
+                bins[bin].allocs += STAT_READ(arena_stats->allocs[bin]);
+            }
+        }
+        for (bin = 0; bin < 4; bin++)
+        {
+            stats->coalesces[bin] += STAT_READ(arena_stats->coalesces[bin]);
+        }
+        stats->top_allocs += STAT_READ(arena_stats->top_allocs);
+        stats->splits += STAT_READ(arena_stats->splits);
+        stats->extend_calls += STAT_READ(arena_stats->extend_calls);
+        stats->extend_bytes += STAT_READ(arena_stats->extend_bytes);
 
-        // Add the new fragment to the segList
-        insert_free_block(block+asize);
+        pthread_mutex_lock(&arena->lock);
+        size_t top_bytes = arena->top ? GET_SIZE(HDRP(arena->top)) : 0;
+        size_t largest = largest_free_block(arena);
+        pthread_mutex_unlock(&arena->lock);
+
+        stats->top_bytes += top_bytes;
+        stats->largest_free = MAX(stats->largest_free, largest);
     }
 
-    return block+WSIZE;
+    stats->free_bytes += stats->top_bytes;
+    stats->fragmentation = stats->free_bytes ? 1.0 - (double)stats->largest_free / stats->free_bytes : 0;
+    stats->mmap_blocks = __atomic_load_n(&mmap_blocks, __ATOMIC_RELAXED);
+    stats->mmap_bytes = __atomic_load_n(&mmap_bytes, __ATOMIC_RELAXED);
+
+    return HASH_SIZE;
 }
 
 /**********************************************************
- * find_fit
- * Traverse the heap searching for a block to fit asize
- * Return NULL if no free blocks can handle that size
- * Assumed that asize is aligned
+ * mm_footprint
+ * Total the memory the allocator has taken for itself: the
+ * heap region of every arena, the runs handed out of the
+ * slab region and the length of every live mapping. Slab
+ * runs are recycled but never given back, so the slab part
+ * only grows. Cheaper than mm_stats: only the locks of
+ * secondary arenas are taken, to read where their heap
+ * ends.
+ *
+ * @return size_t - the footprint in bytes
  **********************************************************/
-void * find_fit(size_t asize)
+size_t mm_footprint(void)
 {
-    int index = map_size_class(asize);
-    void * list_itr;
+    size_t footprint = mem_heapsize();
+    size_t index;
 
-    while (index < HASH_SIZE)
+    for (index = 1; index < NUM_ARENAS; index++)
     {
-        list_itr = segList[index];
-        while (list_itr!=NULL)
+        arena_t * arena = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+        if (arena == NULL)
         {
-            //First fit search.
-            //Split the free block and allocate the necessary bytes
-            //The half that remains free will be added to the correct 
-            //size class in the segregated list.
-            if (GET_SIZE(list_itr) >= asize)
-            {
-                return break_block_and_return_bp(list_itr, asize);
-            }
-            list_itr = (void *)GET_PRED_PTR(list_itr);
+            continue;
         }
-        index ++;
+        pthread_mutex_lock(&arena->lock);
+        footprint += arena->brk - (char *)arena;
+        pthread_mutex_unlock(&arena->lock);
     }
 
-    return NULL;
+    footprint += __atomic_load_n(&slab_bytes, __ATOMIC_RELAXED);
+    return footprint + __atomic_load_n(&mmap_bytes, __ATOMIC_RELAXED);
 }
 
 /**********************************************************
- * place
- * Mark the block as allocated
+ * mm_fork_prepare
+ * Take every lock of the allocator, so that fork does not
+ * copy a heap some other thread is halfway through
+ * changing. Meant for pthread_atfork along with
+ * mm_fork_parent and mm_fork_child. Locks are taken in the
+ * order the allocator nests them: the arena list, every
+ * arena in index order, then the slab region.
  **********************************************************/
-void place(void* bp, size_t asize)
+void mm_fork_prepare(void)
 {
-    /* Get the current block size */
-    size_t bsize = GET_SIZE(HDRP(bp));
+    size_t index;
 
-    PUT(HDRP(bp), PACK(bsize, 1));
-    PUT(FTRP(bp), PACK(bsize, 1));
+    pthread_mutex_lock(&arenas_lock);
+    for (index = 0; index < NUM_ARENAS; index++)
+    {
+        if (arenas[index] != NULL)
+        {
+            pthread_mutex_lock(&arenas[index]->lock);
+        }
+    }
+    pthread_mutex_lock(&slab_lock);
 }
 
 /**********************************************************
- * mm_free
- * Free the block and coalesce with neighbouring blocks
+ * mm_fork_parent
+ * Release the locks taken by mm_fork_prepare in the parent.
  **********************************************************/
-void mm_free(void *bp)
+void mm_fork_parent(void)
 {
-    if(bp == NULL){
-      return;
+    size_t index;
+
+    pthread_mutex_unlock(&slab_lock);
+    for (index = NUM_ARENAS; index-- > 0; )
+    {
+        if (arenas[index] != NULL)
+        {
+            pthread_mutex_unlock(&arenas[index]->lock);
+        }
     }
-    size_t size = GET_SIZE(HDRP(bp));
-    PUT(HDRP(bp), PACK(size,0));
-    PUT(FTRP(bp), PACK(size,0));
-    if (!dont_coalesce) { bp = coalesce(bp); }
-    insert_free_block(HDRP(bp));
+    pthread_mutex_unlock(&arenas_lock);
 }
 
+/**********************************************************
+ * mm_fork_child
+ * Reset the locks taken by mm_fork_prepare in the child,
+ * which only has the thread that called fork. The caches
+ * of the threads that did not make it into the child are
+ * lost, along with the blocks in them.
+ **********************************************************/
+void mm_fork_child(void)
+{
+    size_t index;
+
+    pthread_mutex_init(&slab_lock, NULL);
+    for (index = 0; index < NUM_ARENAS; index++)
+    {
+        if (arenas[index] != NULL)
+        {
+            pthread_mutex_init(&arenas[index]->lock, NULL);
+        }
+    }
+    pthread_mutex_init(&arenas_lock, NULL);
+}
 
 /**********************************************************
- * mm_malloc
- * Allocate a block of size bytes.
- * The type of search is determined by find_fit
- * The decision of splitting the block, or not is determined
- *   in place(..)
- * If no block satisfies the request, the heap is extended
+ * mm_trim
+ * Release as much free memory to the OS as possible. The
+ * calling thread's cache is flushed, the remote-free stacks
+ * are drained, the quick lists are consolidated, every
+ * whole page inside a free block is released and the top
+ * chunk of each arena is trimmed down to pad bytes. The
+ * heap keeps its address space, released pages fault back
+ * in as zero pages.
+ *
+ * @return int - 1 if any memory was released, 0 otherwise
  **********************************************************/
-void *mm_malloc(size_t size)
+int mm_trim(size_t pad)
 {
-    size_t asize; /* adjusted block size */
-    char * bp;
+    tcache_t * tc = tcache_get();
+    bool released = false;
+    size_t index;
 
-    /* Ignore spurious requests */
-    if (size == 0)
-        return NULL;
+    for (index = 0; index < TCACHE_BINS; index++)
+    {
+        tcache_flush(index, tc->counts[index]);
+    }
 
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1))/ DSIZE);
+    for (index = 0; index < NUM_ARENAS; index++)
+    {
+        arena_t * arena = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+        if (arena == NULL)
+        {
+            continue;
+        }
 
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-        return bp;
+        pthread_mutex_lock(&arena->lock);
+        remote_drain(arena);
+        quick_consolidate(arena);
+        size_t bin;
+        for (bin = 0; bin < HASH_SIZE; bin++)
+        {
+            void * curr_node;
+            for (curr_node = arena->segList[bin]; curr_node; curr_node = (void *)GET_PRED_PTR(curr_node))
+            {
+                char * bp = (char *)curr_node + TSIZE;
+                released |= release_block_pages(bp, bp, FTRP(bp));
+            }
+        }
+        released |= trim_top(arena, pad);
+        pthread_mutex_unlock(&arena->lock);
     }
 
-    /* No fit found. Get more memory and place the block */
-    if ((bp = extend_heap(asize)) == NULL)
-        return NULL;
-    place(bp, asize);
-    return bp;
+    return released;
+}
 
+#ifdef MM_PROFILE
+/**********************************************************
+ * profile_now
+ * Read the cycle counter, or the monotonic clock in ns on
+ * machines without one we know how to read.
+ **********************************************************/
+static inline uint64_t profile_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile ("mrs %0, cntvct_el0" : "=r" (ticks));
+    return ticks;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
 }
 
 /**********************************************************
- * mm_realloc
- * Implemented simply in terms of mm_malloc and mm_free
- *********************************************************/
-void *mm_realloc(void *ptr, size_t size)
+ * profile_bucket
+ * Map a value to its log-linear histogram bucket.
+ **********************************************************/
+static inline size_t profile_bucket(uint64_t value)
 {
-    /* If size == 0 then this is just free, and we return NULL. */
-    if(size == 0)
+    if (value < (1UL << PROF_SUB_LOG2))
     {
-      mm_free(ptr);
-      return NULL;
+        return value;
     }
-    /* If oldptr is NULL, then this is just malloc. */
-    if (ptr == NULL)
+
+    size_t log2 = 63 - __builtin_clzl(value);
+    size_t sub = (value >> (log2 - PROF_SUB_LOG2)) & ((1UL << PROF_SUB_LOG2) - 1);
+    return ((log2 - PROF_SUB_LOG2 + 1) << PROF_SUB_LOG2) + sub;
+}
+
+/**********************************************************
+ * profile_bucket_max
+ * The largest value that falls into a bucket, the inverse
+ * of profile_bucket.
+ **********************************************************/
+static uint64_t profile_bucket_max(size_t bucket)
+{
+    if (bucket < (1UL << PROF_SUB_LOG2))
     {
-      return (mm_malloc(size));
+        return bucket;
     }
 
-    void *oldptr = ptr;
-    void *newptr;
-    size_t copySize = GET_SIZE(HDRP(oldptr));
-    size_t asize = DSIZE * ((size + (DSIZE) + (DSIZE-1))/ DSIZE);
+    size_t log2 = (bucket >> PROF_SUB_LOG2) + PROF_SUB_LOG2 - 1;
+    uint64_t sub = bucket & ((1UL << PROF_SUB_LOG2) - 1);
+    return (((1UL << PROF_SUB_LOG2) + sub + 1) << (log2 - PROF_SUB_LOG2)) - 1;
+}
+
+/**********************************************************
+ * profile_record
+ * Add a value to an event's histogram. The counters are
+ * shared by all threads and updated with relaxed atomics.
+ **********************************************************/
+static inline void profile_record(enum profile_event event, uint64_t value)
+{
+    profile_hist_t * hist = &profile_hists[event];
+    __atomic_fetch_add(&hist->buckets[profile_bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, value, __ATOMIC_RELAXED);
+}
+
+/**********************************************************
+ * profile_scope_end
+ * Cleanup handler of PROFILE_SCOPE. A find_fit scope also
+ * records how many nodes the search visited.
+ **********************************************************/
+static inline void profile_scope_end(profile_scope_t * scope)
+{
+    // The counter can step back when the thread moves to another core
+    uint64_t end = profile_now();
+    profile_record(scope->event, end > scope->start ? end - scope->start : 0);
 
-    /* If the size is big enough, return as is */
-    if (copySize >= asize)
+    if (scope->event == PROF_FIND_FIT)
     {
-        return oldptr;
+        profile_record(PROF_FIND_FIT_NODES, profile_nodes);
+        profile_nodes = 0;
     }
+}
 
-    /* Free before a dynamic allocation via malloc to reduce fragmentation. 
-     * If the free block is at the end, it will be reused with the part of 
-     * the heap that we will extend. In order to preserve the data in the free block,
-     * we need to prevent it from coalescing it with the previous block so that 
-     * it is not broken up later at any arbitrary point and the data at those points
-     * overwritten by headers and footers.
-     *
-     *  We also need to save the 2 words where next and previous pointers will be saved
-     */
-    uintptr_t word1 = GET(oldptr);
-    uintptr_t word2 = GET(oldptr+WSIZE);
-    
-    dont_coalesce = true;
-    mm_free(oldptr);
-    dont_coalesce = false;
+/**********************************************************
+ * mm_profile_reset
+ * Clear every histogram.
+ **********************************************************/
+void mm_profile_reset(void)
+{
+    memset(profile_hists, 0, sizeof(profile_hists));
+}
 
-    newptr = mm_malloc(size*2);
-    if (newptr == NULL)
+/**********************************************************
+ * profile_percentile
+ * Upper bound of the bucket holding the given fraction of
+ * an event's samples.
+ **********************************************************/
+static uint64_t profile_percentile(const profile_hist_t * hist, double fraction)
+{
+    uint64_t rank = (uint64_t)(fraction * hist->count);
+    uint64_t seen = 0;
+    size_t bucket;
+
+    for (bucket = 0; bucket < PROF_BUCKETS; bucket++)
     {
-        return NULL;
+        seen += hist->buckets[bucket];
+        if (seen > rank)
+        {
+            return profile_bucket_max(bucket);
+        }
     }
+    return profile_bucket_max(PROF_BUCKETS - 1);
+}
+
+/**********************************************************
+ * mm_profile_dump
+ * Print the sample count, mean and p50/p99/p999 of every
+ * histogram. Latencies are in cycle-counter ticks and the
+ * percentiles are bucket upper bounds.
+ **********************************************************/
+void mm_profile_dump(FILE * out)
+{
+    static const char * names[PROF_EVENTS] = {
+        "mm_malloc", "mm_free", "mm_realloc", "find_fit", "coalesce", "extend_heap", "find_fit nodes"
+    };
+    size_t event;
 
-    /* Copy the old data. */
-    if (size < copySize)
+    fprintf(out, "%-16s %12s %10s %10s %10s %10s\n", "event", "count", "mean", "p50", "p99", "p999");
+    for (event = 0; event < PROF_EVENTS; event++)
     {
-        copySize = size;
+        const profile_hist_t * hist = &profile_hists[event];
+        if (hist->count == 0)
+        {
+            continue;
+        }
+        fprintf(out, "%-16s %12lu %10.1f %10lu %10lu %10lu\n", names[event],
+                (unsigned long)hist->count, (double)hist->sum / hist->count,
+                (unsigned long)profile_percentile(hist, 0.5),
+                (unsigned long)profile_percentile(hist, 0.99),
+                (unsigned long)profile_percentile(hist, 0.999));
     }
-    memcpy(newptr, oldptr, copySize);
-
-    /* Write back the 2 words that were overwritten by next and previous pointers */
-    PUT(newptr, word1);
-    PUT(newptr+WSIZE, word2);
-    return newptr;
 }
+#endif
 
 /**********************************************************
  * mm_check
- * Check the consistency of the memory heap
- * Return nonzero if the heap is consistent.
- *
- * Consistency Checks include:
- * 1) Is every block in the free list marked as free?
- * 2) Are there any contiguous free blocks that escaped
- *    coalescing?
- * 3) Are all blocks marked as free in the heap added
- *    to the segregated list?
- * 4) Do all blocks hashing to a certain index in the 
- *    hash table fit within the correct size class of the
- *    segregated free list?
- *    
+ * Run the consistency checks on every arena, holding each
+ * arena's lock while it is checked.
  *********************************************************/
 int mm_check(void)
 {
     int result = 1;
-    size_t itr;
+    size_t index;
 
-    /* Is every block in the free list marked as free? */
-    // Iterate through all indices in the hash table.
-    for(itr = 0; itr < HASH_SIZE; itr++)
+    for (index = 0; index < NUM_ARENAS; index++)
     {
-        void *currNode = segList[itr];
-        //Iterate through the list of free blocks within the index
-        while(currNode)
+        arena_t * arena = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+        if (arena != NULL)
         {
-            //If a block is allocated in the list, this is an error.
-            if(GET_ALLOC(currNode))
-            {
-                fprintf(stderr, "[mm_check Error] a block in the seglist is still allocated\n");
-                result = 0;
-            }
-            currNode = (void*) GET_PRED_PTR(currNode);
-        }   
+            pthread_mutex_lock(&arena->lock);
+            result &= check_arena(arena);
+            pthread_mutex_unlock(&arena->lock);
+        }
     }
 
-    /* Are there any contiguous free blocks that somehow escaped coalescing? */
-    void *itr_pointer = (char *)prologue_ptr + WSIZE;
+    return result;
+}
+
+/**********************************************************
+ * mm_check_incremental
+ * Check the next budget blocks of one arena's heap with
+ * check_block, holding its lock only for that slice. Each
+ * call resumes where the previous one stopped and moves on
+ * to the next arena once the end of a heap is reached, so
+ * calling it regularly covers every block while bounding
+ * the time any request waits for the checker. The global
+ * invariants that need a full walk, like every listed block
+ * being in the heap, are left to mm_check.
+ *
+ * @return int - 1 if every block checked is consistent
+ **********************************************************/
+int mm_check_incremental(size_t budget)
+{
+    size_t start = __atomic_load_n(&check_next_arena, __ATOMIC_RELAXED);
+    size_t index = start;
+    arena_t * arena = NULL;
+    int result = 1;
+    size_t tries;
 
-    while(itr_pointer != (char *)epilogue_ptr+WSIZE)
+    for (tries = 0; tries < NUM_ARENAS && arena == NULL; tries++)
     {
-        bool currAlloc = GET_ALLOC(HDRP(itr_pointer));
-        void * next_bp = NEXT_BLKP(itr_pointer);
-        bool nextAlloc = GET_ALLOC(HDRP(next_bp));
-        if(!currAlloc && !nextAlloc)
-        {
-            fprintf(stderr, "[mm_check Error] Two contiguous blocks missed coalescing.\n");
-            result = 0;
-        }
-        /* Does every free block actually exist in the free list */
-        if(!currAlloc && !is_block_in_seglist(HDRP(itr_pointer)))
-        {
-            fprintf(stderr, "[mm_check Error] Free block is not in segregated list \n");
-            result = 0;
-        }
-        itr_pointer = next_bp;
+        index = (start + tries) % NUM_ARENAS;
+        arena = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+    }
+    if (arena == NULL)
+    {
+        return result;
     }
 
-    /* Do the list of blocks in each index of the hash table fit the corresponding size class? */
-    // Example: blocks in index 5 are between size 17-32 (2^4<SIZE<=2^5)
-    
-    //Iterate through hash_table from 0 to HASH_SIZE
-    for(itr = 5; itr < HASH_SIZE; itr++)
+    pthread_mutex_lock(&arena->lock);
+    void * end = (char *)arena->epilogue_ptr + TSIZE;
+    void * bp = arena->check_cursor ? arena->check_cursor : (char *)arena->prologue_ptr + TSIZE;
+
+    while (budget-- && bp != end)
     {
-        int minSize = 1<<(itr-1);
-        int maxSize = 1<<(itr);
-        void *currNode = segList[itr];
-        //Iterate through the list of free blocks within the index
-        while(currNode)
-        {
-            // If a block is outside the size class range, it's an error.
-            // If its the last bucket, don't enforce max range since the last bucket
-            // stores everything larger than it also
-            if(GET_SIZE(currNode) <= minSize || (GET_SIZE(currNode) > maxSize && itr!=HASH_SIZE-1))
-            {
-                fprintf(stderr, "[mm_check Error] This block is outside its size class range\n");
-                result = 0;
-            }
-            currNode = (void*) GET_PRED_PTR(currNode);
-        }   
+        result &= check_block(arena, bp);
+        bp = NEXT_BLKP(bp);
     }
 
-    return result;
+    if (bp == end)
+    {
+        arena->check_cursor = NULL;
+        __atomic_store_n(&check_next_arena, (index + 1) % NUM_ARENAS, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        arena->check_cursor = bp;
+    }
+    pthread_mutex_unlock(&arena->lock);
 
-}
\ No newline at end of file
+    return result;
+}
@@ -0,0 +1,134 @@
+/* C++ allocators on top of the allocator.
+ *
+ * mm::memory_resource is a std::pmr::memory_resource for the pmr
+ * containers, and mm::allocator<T> a standard allocator for the
+ * others. Both hand the size of every deallocation down to
+ * mm_free_sized, which picks the thread cache bin from it instead
+ * of reading the block's header.
+ *
+ * For a fixed-size T, like the nodes of std::map, the size is a
+ * constant: mm::allocator<T> resolves the alignment path at compile
+ * time, and building mm.c and the program with -flto folds the size
+ * class computation of mm_free_sized to a constant as well.
+ *
+ * Blocks are 16 byte aligned, stricter alignments are served by
+ * mm_memalign. Allocation failure throws std::bad_alloc.
+ */
+
+#ifndef MM_ALLOCATOR_HPP
+#define MM_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <memory_resource>
+
+extern "C" {
+#include "mm.h"
+
+/* Exported by mm.c, but not part of the lab's mm.h */
+void * mm_memalign(size_t alignment, size_t size);
+void   mm_free_sized(void * ptr, size_t size);
+}
+
+namespace mm {
+
+/* Alignment of every block mm_malloc returns */
+constexpr std::size_t malloc_alignment = 16;
+
+/* Allocate bytes aligned to alignment. Zero bytes still get a
+ * unique block, which mm_malloc does not hand out. */
+inline void * allocate_bytes(std::size_t bytes, std::size_t alignment)
+{
+    bytes = bytes ? bytes : 1;
+    void * ptr = alignment <= malloc_alignment ? mm_malloc(bytes) : mm_memalign(alignment, bytes);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+/* Free a block of allocate_bytes, with the same bytes and alignment */
+inline void deallocate_bytes(void * ptr, std::size_t bytes, std::size_t alignment) noexcept
+{
+    if (alignment <= malloc_alignment)
+    {
+        mm_free_sized(ptr, bytes ? bytes : 1);
+    }
+    else
+    {
+        mm_free(ptr);
+    }
+}
+
+/* The heap as a memory resource. It has no state, so every
+ * instance compares equal to every other. */
+class memory_resource final : public std::pmr::memory_resource
+{
+private:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return allocate_bytes(bytes, alignment);
+    }
+
+    void do_deallocate(void * ptr, std::size_t bytes, std::size_t alignment) override
+    {
+        deallocate_bytes(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+    {
+        return dynamic_cast<const memory_resource *>(&other) != nullptr;
+    }
+};
+
+/* The process-wide resource, like std::pmr::new_delete_resource */
+inline memory_resource * resource() noexcept
+{
+    static memory_resource instance;
+    return &instance;
+}
+
+template <class T>
+class allocator
+{
+public:
+    using value_type = T;
+
+    allocator() noexcept = default;
+
+    template <class U>
+    allocator(const allocator<U> &) noexcept
+    {
+    }
+
+    T * allocate(std::size_t n)
+    {
+        if (n > static_cast<std::size_t>(-1) / sizeof(T))
+        {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T *>(allocate_bytes(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T * ptr, std::size_t n) noexcept
+    {
+        deallocate_bytes(ptr, n * sizeof(T), alignof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const allocator<T> &, const allocator<U> &) noexcept
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const allocator<T> &, const allocator<U> &) noexcept
+{
+    return false;
+}
+
+}
+
+#endif
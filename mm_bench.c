@@ -0,0 +1,134 @@
+/* Microbenchmark for the mm_malloc/mm_free hot path.
+ *
+ * Keeps a window of live blocks and repeatedly frees a random
+ * one and allocates a replacement, so find_fit sees a mix of
+ * populated and empty bins. Each phase draws its request sizes
+ * from a different distribution and reports the mean latency
+ * of one mm_malloc + mm_free pair.
+ *
+ * Build against the allocator and the lab's memlib:
+ *     gcc -O2 -pthread mm_bench.c mm.c memlib.c -o mm_bench
+ *
+ * Usage: mm_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define WINDOW      4096        /* live blocks kept around between calls */
+#define DEFAULT_OPS 1000000
+
+typedef struct phase {
+    const char * name;
+    size_t       small_max;     /* upper bound of small requests */
+    size_t       large_max;     /* upper bound of large requests */
+    int          large_pct;     /* percentage of requests drawn from the large range */
+} phase_t;
+
+static const phase_t phases[] = {
+    { "small",  256,   0,      0   },
+    { "large",  256,   65536,  100 },
+    { "mixed",  256,   65536,  20  },
+    { "sparse", 64,    524288, 5   },
+};
+
+/**********************************************************
+ * next_size
+ * Draw a request size for a phase from a xorshift stream.
+ **********************************************************/
+static size_t next_size(const phase_t * phase, uint64_t * state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+
+    if ((int)(x % 100) < phase->large_pct)
+    {
+        return phase->small_max + 1 + (x >> 8) % (phase->large_max - phase->small_max);
+    }
+    return 1 + (x >> 8) % phase->small_max;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**********************************************************
+ * run_phase
+ * Replay ops free/malloc pairs against a fresh heap.
+ *
+ * @return double mean nanoseconds per pair, or a negative
+ *                value if the heap ran out of memory
+ *
+ **********************************************************/
+static double run_phase(const phase_t * phase, long ops)
+{
+    static void * live[WINDOW];
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    long itr;
+
+    mem_reset_brk();
+    if (mm_init() != 0)
+    {
+        return -1;
+    }
+
+    for (itr = 0; itr < WINDOW; itr++)
+    {
+        if ((live[itr] = mm_malloc(next_size(phase, &state))) == NULL)
+        {
+            return -1;
+        }
+    }
+
+    double start = now_ns();
+    for (itr = 0; itr < ops; itr++)
+    {
+        size_t slot = (state >> 16) % WINDOW;
+        mm_free(live[slot]);
+        if ((live[slot] = mm_malloc(next_size(phase, &state))) == NULL)
+        {
+            return -1;
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    for (itr = 0; itr < WINDOW; itr++)
+    {
+        mm_free(live[itr]);
+    }
+
+    return elapsed / ops;
+}
+
+int main(int argc, char **argv)
+{
+    long ops = argc > 1 ? atol(argv[1]) : DEFAULT_OPS;
+    size_t itr;
+
+    mem_init();
+
+    printf("%-8s %14s\n", "phase", "ns/malloc+free");
+    for (itr = 0; itr < sizeof(phases) / sizeof(phases[0]); itr++)
+    {
+        double ns = run_phase(&phases[itr], ops);
+        if (ns < 0)
+        {
+            printf("%-8s %14s\n", phases[itr].name, "out of memory");
+            continue;
+        }
+        printf("%-8s %14.1f\n", phases[itr].name, ns);
+    }
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* Container churn benchmark for the C++ allocators.
+ *
+ * Runs the same container workloads with the default allocator,
+ * with mm::allocator and with std::pmr containers on
+ * mm::resource(), and reports the mean time of one operation:
+ *
+ *     vector         fill a std::vector<int> by push_back to a
+ *                    random length and drop it, so its buffer
+ *                    regrows through every size on the way
+ *     map            insert and erase random keys of a
+ *                    std::map<int, int> held at WINDOW entries
+ *     unordered_map  the same with a std::unordered_map<int, int>
+ *
+ * Build mm.c as C and link it in, along with the lab's memlib:
+ *     gcc -O2 -pthread -c mm.c memlib.c
+ *     g++ -O2 -std=c++17 -pthread mm_cxx_bench.cpp mm.o memlib.o -o mm_cxx_bench
+ *
+ * Usage: mm_cxx_bench [operations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "mm_allocator.hpp"
+
+extern "C" {
+#include "memlib.h"
+}
+
+#define DEFAULT_OPS 1000000
+#define WINDOW      65536           /* entries the maps are held at */
+#define VECTOR_MAX  4096            /* longest vector built */
+
+static std::uint64_t rng_state;
+
+/**********************************************************
+ * next_random
+ * Draw from a xorshift stream.
+ **********************************************************/
+static std::uint64_t next_random()
+{
+    std::uint64_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rng_state = x;
+    return x;
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**********************************************************
+ * vector_churn
+ * Build vectors of random length, one push_back per
+ * operation.
+ **********************************************************/
+template <class Vector>
+static void vector_churn(long ops, const typename Vector::allocator_type & alloc)
+{
+    long done = 0;
+
+    while (done < ops)
+    {
+        Vector vector(alloc);
+        long length = 1 + next_random() % VECTOR_MAX;
+        for (long itr = 0; itr < length && done < ops; itr++, done++)
+        {
+            vector.push_back(static_cast<int>(itr));
+        }
+    }
+}
+
+/**********************************************************
+ * map_churn
+ * Fill a map to WINDOW entries, then erase a random key
+ * and insert another one per operation.
+ **********************************************************/
+template <class Map>
+static void map_churn(long ops, const typename Map::allocator_type & alloc)
+{
+    Map map(alloc);
+    long itr;
+
+    while (map.size() < WINDOW)
+    {
+        map.emplace(static_cast<int>(next_random()), 0);
+    }
+    for (itr = 0; itr < ops; itr++)
+    {
+        auto victim = map.find(static_cast<int>(next_random()));
+        map.erase(victim != map.end() ? victim : map.begin());
+        map.emplace(static_cast<int>(next_random()), static_cast<int>(itr));
+    }
+}
+
+/**********************************************************
+ * run
+ * Time one workload against a fresh heap.
+ *
+ * @return double mean nanoseconds per operation, or a
+ *                negative value if the heap ran out of
+ *                memory
+ **********************************************************/
+static double run(const std::function<void(long)> & workload, long ops)
+{
+    rng_state = 0x9E3779B97F4A7C15ULL;
+    mem_reset_brk();
+    if (mm_init() != 0)
+    {
+        return -1;
+    }
+
+    double start = now_ns();
+    try
+    {
+        workload(ops);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return -1;
+    }
+    return (now_ns() - start) / ops;
+}
+
+int main(int argc, char ** argv)
+{
+    long ops = argc > 1 ? std::atol(argv[1]) : DEFAULT_OPS;
+
+    using std_vector = std::vector<int>;
+    using mm_vector = std::vector<int, mm::allocator<int>>;
+    using std_map = std::map<int, int>;
+    using mm_map = std::map<int, int, std::less<int>, mm::allocator<std::pair<const int, int>>>;
+    using std_hash = std::unordered_map<int, int>;
+    using mm_hash = std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                                       mm::allocator<std::pair<const int, int>>>;
+
+    struct workload {
+        const char *              name;
+        std::function<void(long)> run[3];       /* default, mm::allocator, pmr on mm::resource */
+    } workloads[] = {
+        { "vector", {
+            [](long n) { vector_churn<std_vector>(n, {}); },
+            [](long n) { vector_churn<mm_vector>(n, {}); },
+            [](long n) { vector_churn<std::pmr::vector<int>>(n, mm::resource()); } } },
+        { "map", {
+            [](long n) { map_churn<std_map>(n, {}); },
+            [](long n) { map_churn<mm_map>(n, {}); },
+            [](long n) { map_churn<std::pmr::map<int, int>>(n, mm::resource()); } } },
+        { "unordered_map", {
+            [](long n) { map_churn<std_hash>(n, {}); },
+            [](long n) { map_churn<mm_hash>(n, {}); },
+            [](long n) { map_churn<std::pmr::unordered_map<int, int>>(n, mm::resource()); } } },
+    };
+
+    if (ops <= 0)
+    {
+        std::fprintf(stderr, "usage: %s [operations]\n", argv[0]);
+        return 2;
+    }
+
+    mem_init();
+
+    std::printf("%-14s %12s %12s %12s\n", "workload", "default", "mm", "mm pmr");
+    for (const workload & entry : workloads)
+    {
+        std::printf("%-14s", entry.name);
+        for (const auto & workload : entry.run)
+        {
+            double ns = run(workload, ops);
+            if (ns < 0)
+                std::printf(" %12s", "out of memory");
+            else
+                std::printf(" %9.1f ns", ns);
+        }
+        std::printf("\n");
+    }
+
+    return 0;
+}
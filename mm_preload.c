@@ -0,0 +1,378 @@
+/* LD_PRELOAD shim that makes the allocator the process's malloc.
+ *
+ * Exports the standard malloc family on top of mm.c, so that
+ * unmodified programs can be run against it and compared with
+ * glibc end to end:
+ *
+ *     malloc free realloc reallocarray calloc
+ *     memalign posix_memalign aligned_alloc valloc pvalloc
+ *     malloc_usable_size
+ *
+ * Every entry point is exported, not just the ones programs
+ * commonly call, because a block from glibc's allocator handed to
+ * mm_free, or the other way around, corrupts both heaps.
+ *
+ * The lab's memlib cannot back the heap here, as it gets its own
+ * memory from malloc. The shim provides the two memlib calls mm.c
+ * makes itself: mem_pagesize, and mem_sbrk bumping through a
+ * PRELOAD_HEAP_SIZE reservation that is only backed by memory as
+ * it is touched.
+ *
+ * The heap is set up by the first call into the shim, whichever
+ * thread makes it and however early in the life of the process.
+ * Calls that arrive while it is being set up, from the thread
+ * doing so, are served from a small static bootstrap buffer that
+ * is never reused. Once the heap is up, the shim registers fork
+ * handlers that hold every allocator lock across fork, so the
+ * child never inherits a heap another thread was changing.
+ *
+ * Build as a shared library and preload it. The reservation is
+ * never handed out twice, so mm.c may count on mem_sbrk memory
+ * being zero, and the thread caches must not be allocated lazily
+ * by the TLS machinery, which would call malloc:
+ *     gcc -O2 -fPIC -shared -pthread -ftls-model=initial-exec \
+ *         -DMEM_SBRK_CLEARS=1 mm_preload.c mm.c -o libmm.so
+ *     LD_PRELOAD=./libmm.so some-program
+ *
+ * With MM_PRELOAD_STATS set in the environment, the allocator's
+ * mm_stats summary is printed to stderr when the process exits.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "mm_stats.h"
+#include "memlib.h"
+
+#ifndef PRELOAD_HEAP_SIZE
+#define PRELOAD_HEAP_SIZE   (64UL << 30)    /* address space reserved for the main arena */
+#endif
+#ifndef BOOTSTRAP_SIZE
+#define BOOTSTRAP_SIZE      (64UL << 10)    /* serves the calls made while the heap is set up */
+#endif
+
+#define EXPORT __attribute__((visibility("default")))
+
+/* Exported by mm.c, but not part of the lab's mm.h */
+void * mm_calloc(size_t nmemb, size_t size);
+void * mm_memalign(size_t alignment, size_t size);
+int    mm_posix_memalign(void ** memptr, size_t alignment, size_t size);
+size_t mm_usable_size(void * ptr);
+void   mm_fork_prepare(void);
+void   mm_fork_parent(void);
+void   mm_fork_child(void);
+
+enum { HEAP_NONE, HEAP_INITIALIZING, HEAP_READY };
+
+static int              heap_state = HEAP_NONE;
+static __thread bool    initializing = false;    /* this thread is setting the heap up */
+
+/* The mem_sbrk heap */
+static char *           heap_start = NULL;
+static char *           heap_brk = NULL;
+static pthread_mutex_t  heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Bootstrap blocks are bump allocated and carry their size in the word in front */
+static char             bootstrap[BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static size_t           bootstrap_used = 0;
+
+#define IS_BOOTSTRAP_PTR(p) ((char *)(p) >= bootstrap && (char *)(p) < bootstrap + BOOTSTRAP_SIZE)
+#define BOOTSTRAP_SIZE_OF(p) (*(size_t *)((char *)(p) - 16))
+
+/**********************************************************
+ * mem_sbrk
+ * memlib's sbrk, over the reservation made by heap_init.
+ * mm.c calls it with its arena lock held, so only the main
+ * arena's extensions are serialized here.
+ *
+ * @return void * the old break, or (void *)-1 with errno
+ *                set to ENOMEM once the reservation is used
+ **********************************************************/
+void * mem_sbrk(int incr)
+{
+    pthread_mutex_lock(&heap_lock);
+    char * old_brk = heap_brk;
+    if (incr < 0 || (size_t)incr > (size_t)(heap_start + PRELOAD_HEAP_SIZE - heap_brk))
+    {
+        pthread_mutex_unlock(&heap_lock);
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    heap_brk += incr;
+    pthread_mutex_unlock(&heap_lock);
+    return old_brk;
+}
+
+size_t mem_pagesize(void)
+{
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+/**********************************************************
+ * bootstrap_alloc
+ * Bump allocate from the bootstrap buffer. Its blocks are
+ * never freed, the buffer only has to last until the heap
+ * is set up.
+ **********************************************************/
+static void * bootstrap_alloc(size_t size)
+{
+    size_t used = bootstrap_used + 16 + ((size + 15) & ~(size_t)15);
+    if (size > BOOTSTRAP_SIZE || used > BOOTSTRAP_SIZE)
+    {
+        return NULL;
+    }
+
+    char * bp = bootstrap + bootstrap_used + 16;
+    BOOTSTRAP_SIZE_OF(bp) = size;
+    bootstrap_used = used;
+    return bp;
+}
+
+static void fork_prepare(void)
+{
+    mm_fork_prepare();
+    pthread_mutex_lock(&heap_lock);
+}
+
+static void fork_parent(void)
+{
+    pthread_mutex_unlock(&heap_lock);
+    mm_fork_parent();
+}
+
+static void fork_child(void)
+{
+    pthread_mutex_init(&heap_lock, NULL);
+    mm_fork_child();
+}
+
+static void print_stats(void)
+{
+    mm_stats_t stats;
+    mm_stats(&stats, NULL, 0);
+    fprintf(stderr, "mm: %zu bytes free, %zu of them in top chunks, largest free block %zu, "
+            "%zu bytes mapped in %zu blocks\n", stats.free_bytes, stats.top_bytes,
+            stats.largest_free, stats.mmap_bytes, stats.mmap_blocks);
+}
+
+/**********************************************************
+ * heap_init
+ * Set the heap up on the first call into the shim. The
+ * thread that wins the race reserves the heap and runs
+ * mm_init, the others wait for it. Anything that allocates
+ * during setup, like pthread_atfork, runs only once the
+ * heap is ready, as it would otherwise be served from the
+ * bootstrap buffer for no reason.
+ *
+ * @return bool - false if the calling thread is the one
+ *                setting the heap up, and has to use the
+ *                bootstrap buffer
+ **********************************************************/
+static bool heap_init(void)
+{
+    int state = __atomic_load_n(&heap_state, __ATOMIC_ACQUIRE);
+    if (state == HEAP_READY)
+    {
+        return true;
+    }
+    if (initializing)
+    {
+        return false;
+    }
+
+    state = HEAP_NONE;
+    if (!__atomic_compare_exchange_n(&heap_state, &state, HEAP_INITIALIZING, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_load_n(&heap_state, __ATOMIC_ACQUIRE) != HEAP_READY)
+        {
+            sched_yield();
+        }
+        return true;
+    }
+
+    initializing = true;
+    heap_start = mmap(NULL, PRELOAD_HEAP_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    heap_brk = heap_start;
+    if (heap_start == MAP_FAILED || mm_init() != 0)
+    {
+        static const char message[] = "mm: cannot set up the heap\n";
+        if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0)
+            _exit(127);
+        abort();
+    }
+    initializing = false;
+    __atomic_store_n(&heap_state, HEAP_READY, __ATOMIC_RELEASE);
+
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+    if (getenv("MM_PRELOAD_STATS") != NULL)
+    {
+        atexit(print_stats);
+    }
+    return true;
+}
+
+EXPORT void * malloc(size_t size)
+{
+    void * bp;
+
+    if (!heap_init())
+    {
+        return bootstrap_alloc(size);
+    }
+
+    // mm_malloc returns NULL for zero bytes, callers of malloc expect a unique pointer
+    if ((bp = mm_malloc(size ? size : 1)) == NULL)
+    {
+        errno = ENOMEM;
+    }
+    return bp;
+}
+
+EXPORT void free(void * ptr)
+{
+    if (ptr != NULL && !IS_BOOTSTRAP_PTR(ptr))
+    {
+        mm_free(ptr);
+    }
+}
+
+EXPORT void * realloc(void * ptr, size_t size)
+{
+    void * bp;
+
+    if (ptr != NULL && IS_BOOTSTRAP_PTR(ptr))
+    {
+        // Move bootstrap blocks to the heap, they cannot grow in place
+        if ((bp = malloc(size)) != NULL)
+        {
+            size_t old_size = BOOTSTRAP_SIZE_OF(ptr);
+            memcpy(bp, ptr, old_size < size ? old_size : size);
+        }
+        return bp;
+    }
+
+    if (!heap_init())
+    {
+        return bootstrap_alloc(size);
+    }
+
+    if ((bp = mm_realloc(ptr, size)) == NULL && size != 0)
+    {
+        errno = ENOMEM;
+    }
+    return bp;
+}
+
+EXPORT void * reallocarray(void * ptr, size_t nmemb, size_t size)
+{
+    if (nmemb != 0 && size > SIZE_MAX / nmemb)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+EXPORT void * calloc(size_t nmemb, size_t size)
+{
+    void * bp;
+
+    if (nmemb != 0 && size > SIZE_MAX / nmemb)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (!heap_init())
+    {
+        // The bootstrap buffer is static, so it starts out zero and is never reused
+        return bootstrap_alloc(nmemb * size);
+    }
+
+    // Zero bytes still get a unique block, of one byte rather than of the other argument
+    if (nmemb == 0 || size == 0)
+    {
+        nmemb = size = 1;
+    }
+    if ((bp = mm_calloc(nmemb, size)) == NULL)
+    {
+        errno = ENOMEM;
+    }
+    return bp;
+}
+
+EXPORT void * memalign(size_t alignment, size_t size)
+{
+    void * bp;
+
+    if (!heap_init())
+    {
+        // Bootstrap blocks are only 16 byte aligned, nothing needs more during setup
+        return alignment <= 16 ? bootstrap_alloc(size) : NULL;
+    }
+
+    if ((bp = mm_memalign(alignment, size ? size : 1)) == NULL)
+    {
+        errno = (alignment & (alignment - 1)) ? EINVAL : ENOMEM;
+    }
+    return bp;
+}
+
+EXPORT int posix_memalign(void ** memptr, size_t alignment, size_t size)
+{
+    if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+
+    void * bp = memalign(alignment, size);
+    if (bp == NULL)
+    {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+EXPORT void * aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+EXPORT void * valloc(size_t size)
+{
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+EXPORT void * pvalloc(size_t size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    if (size > SIZE_MAX - page_size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return memalign(page_size, (size + page_size - 1) & ~(page_size - 1));
+}
+
+EXPORT size_t malloc_usable_size(void * ptr)
+{
+    if (ptr != NULL && IS_BOOTSTRAP_PTR(ptr))
+    {
+        return BOOTSTRAP_SIZE_OF(ptr);
+    }
+    return mm_usable_size(ptr);
+}
@@ -0,0 +1,210 @@
+/* Regions on top of the allocator, see mm_region.h.
+ *
+ * A region is a list of chunks taken from mm_malloc, newest first,
+ * and a bump pointer into the newest one. Objects are carved from
+ * the bump pointer, 16 byte aligned, and carry no header, so an
+ * allocation that fits the current chunk is an add and a compare.
+ * When the current chunk runs out, the region takes a new one,
+ * twice the size of the last up to REGION_CHUNK_MAX, and leaves
+ * the tail of the old one unused.
+ *
+ * Objects larger than a quarter of the current chunk would waste
+ * too much of it. They get a dedicated chunk of their own, linked
+ * behind the current one, which keeps serving the small objects.
+ *
+ * mm_region_reset frees every chunk but the current one, which is
+ * the largest the region has grown, so a region that is reset
+ * after every request soon serves each request from a single
+ * chunk and stops calling mm_malloc altogether.
+ *
+ * Link it in next to mm.c, for example:
+ *     gcc -O2 -pthread program.c mm_region.c mm.c memlib.c -o program
+ */
+
+#include <stdint.h>
+
+#include "mm.h"
+#include "mm_region.h"
+
+#ifndef REGION_CHUNK_SIZE
+#define REGION_CHUNK_SIZE   (64UL << 10)    /* first chunk of a region created with chunk_size 0 */
+#endif
+#ifndef REGION_CHUNK_MAX
+#define REGION_CHUNK_MAX    (1UL << 20)     /* chunks stop doubling here */
+#endif
+
+#define REGION_ALIGN        16
+#define REGION_ALIGN_UP(n)  (((n) + (REGION_ALIGN - 1)) & ~(size_t)(REGION_ALIGN - 1))
+
+/* Chunk header. Its size keeps the objects after it 16 byte aligned. */
+typedef struct region_chunk {
+    struct region_chunk *   next;           /* next older chunk */
+    char *                  end;            /* end of the chunk */
+} region_chunk_t;
+
+#define CHUNK_START(chunk)  ((char *)(chunk) + sizeof(region_chunk_t))
+
+struct mm_region {
+    region_chunk_t *    chunks;             /* current chunk first, then dedicated and older chunks */
+    char *              cursor;             /* next free byte of the current chunk */
+    char *              limit;              /* end of the current chunk */
+    size_t              chunk_size;         /* size of the next chunk to take */
+};
+
+/**********************************************************
+ * region_chunk_alloc
+ * Take a chunk of size bytes, header included, from the
+ * heap.
+ *
+ * @return region_chunk_t * - the chunk, or NULL if out of
+ *                            memory
+ **********************************************************/
+static region_chunk_t * region_chunk_alloc(size_t size)
+{
+    region_chunk_t * chunk = mm_malloc(size);
+    if (chunk != NULL)
+    {
+        chunk->next = NULL;
+        chunk->end = (char *)chunk + size;
+    }
+    return chunk;
+}
+
+/**********************************************************
+ * mm_region_create
+ * Create an empty region along with its first chunk.
+ *
+ * @return mm_region_t * - the region, or NULL if out of
+ *                         memory
+ **********************************************************/
+mm_region_t * mm_region_create(size_t chunk_size)
+{
+    mm_region_t * region;
+    region_chunk_t * chunk;
+
+    if (chunk_size == 0)
+    {
+        chunk_size = REGION_CHUNK_SIZE;
+    }
+    if (chunk_size > SIZE_MAX - sizeof(region_chunk_t) - REGION_ALIGN)
+    {
+        return NULL;
+    }
+    chunk_size = REGION_ALIGN_UP(chunk_size + sizeof(region_chunk_t));
+
+    if ((region = mm_malloc(sizeof(mm_region_t))) == NULL)
+    {
+        return NULL;
+    }
+    if ((chunk = region_chunk_alloc(chunk_size)) == NULL)
+    {
+        mm_free(region);
+        return NULL;
+    }
+
+    region->chunks = chunk;
+    region->cursor = CHUNK_START(chunk);
+    region->limit = chunk->end;
+    region->chunk_size = chunk_size;
+    return region;
+}
+
+/**********************************************************
+ * region_alloc_slow
+ * Serve an object that does not fit the rest of the current
+ * chunk, from a dedicated chunk if it is large and from a
+ * new current chunk otherwise.
+ *
+ * @return void * - the object, or NULL if out of memory
+ **********************************************************/
+static void * region_alloc_slow(mm_region_t * region, size_t size)
+{
+    region_chunk_t * current = region->chunks;
+    region_chunk_t * chunk;
+
+    if (size > (size_t)(current->end - CHUNK_START(current)) / 4)
+    {
+        if ((chunk = region_chunk_alloc(size + sizeof(region_chunk_t))) == NULL)
+        {
+            return NULL;
+        }
+        chunk->next = current->next;
+        current->next = chunk;
+        return CHUNK_START(chunk);
+    }
+
+    // A chunk at least four times the object, and likely far more, fits it
+    size_t chunk_size = region->chunk_size * 2 <= REGION_CHUNK_MAX ? region->chunk_size * 2 : region->chunk_size;
+    if ((chunk = region_chunk_alloc(chunk_size)) == NULL)
+    {
+        return NULL;
+    }
+    chunk->next = current;
+    region->chunks = chunk;
+    region->chunk_size = chunk_size;
+    region->cursor = CHUNK_START(chunk) + size;
+    region->limit = chunk->end;
+    return CHUNK_START(chunk);
+}
+
+/**********************************************************
+ * mm_region_alloc
+ * Bump allocate an object from the current chunk.
+ *
+ * @return void * - the object, or NULL if out of memory
+ **********************************************************/
+void * mm_region_alloc(mm_region_t * region, size_t size)
+{
+    // Zero bytes still get a unique object, like from malloc
+    if (size > SIZE_MAX - sizeof(region_chunk_t) - REGION_ALIGN)
+    {
+        return NULL;
+    }
+    size = size ? REGION_ALIGN_UP(size) : REGION_ALIGN;
+
+    if (size <= (size_t)(region->limit - region->cursor))
+    {
+        void * bp = region->cursor;
+        region->cursor += size;
+        return bp;
+    }
+    return region_alloc_slow(region, size);
+}
+
+/**********************************************************
+ * mm_region_reset
+ * Free every chunk but the current one and rewind the bump
+ * pointer to its start.
+ **********************************************************/
+void mm_region_reset(mm_region_t * region)
+{
+    region_chunk_t * current = region->chunks;
+    region_chunk_t * chunk = current->next;
+
+    while (chunk != NULL)
+    {
+        region_chunk_t * next = chunk->next;
+        mm_free(chunk);
+        chunk = next;
+    }
+
+    current->next = NULL;
+    region->cursor = CHUNK_START(current);
+}
+
+/**********************************************************
+ * mm_region_destroy
+ * Free every chunk of the region and the region itself.
+ **********************************************************/
+void mm_region_destroy(mm_region_t * region)
+{
+    region_chunk_t * chunk = region->chunks;
+
+    while (chunk != NULL)
+    {
+        region_chunk_t * next = chunk->next;
+        mm_free(chunk);
+        chunk = next;
+    }
+    mm_free(region);
+}
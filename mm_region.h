@@ -0,0 +1,36 @@
+/* Regions on top of the allocator.
+ *
+ * A region serves many short-lived objects that all die together,
+ * like the data of one request. Objects are bump allocated from
+ * large chunks the region takes from mm_malloc, with no header of
+ * their own, and are never freed one by one: mm_region_reset
+ * releases every object of the region at once, mm_region_destroy
+ * releases the region itself. Both only visit the chunks.
+ *
+ * A region is not thread safe; each one must only be used by one
+ * thread at a time. Different regions may be used concurrently.
+ */
+
+#ifndef MM_REGION_H
+#define MM_REGION_H
+
+#include <stddef.h>
+
+typedef struct mm_region mm_region_t;
+
+/* Create a region whose first chunk holds chunk_size bytes, or a
+ * default amount if chunk_size is 0. Returns NULL if out of memory. */
+mm_region_t * mm_region_create(size_t chunk_size);
+
+/* Allocate size bytes, 16 byte aligned, that live until the region
+ * is reset or destroyed. Returns NULL if out of memory. */
+void * mm_region_alloc(mm_region_t * region, size_t size);
+
+/* Free every object of the region. The region keeps its largest
+ * chunk to serve the next objects from. */
+void mm_region_reset(mm_region_t * region);
+
+/* Free every object of the region and the region itself */
+void mm_region_destroy(mm_region_t * region);
+
+#endif
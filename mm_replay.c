@@ -0,0 +1,332 @@
+/* Trace replay driver for the allocator.
+ *
+ * Replays malloc-lab allocation traces against mm_malloc, mm_free
+ * and mm_realloc, or against the system malloc for comparison. A
+ * trace is a list of requests, one per line:
+ *
+ *     a <id> <size>    allocate size bytes as block id
+ *     f <id>           free block id
+ *     r <id> <size>    reallocate block id to size bytes
+ *
+ * optionally preceded by the classic four line header (suggested
+ * heap size, number of ids, number of ops, weight), which is only
+ * used as a sizing hint.
+ *
+ * For each trace the driver reports throughput over the best of
+ * the repetitions, utilization as peak live payload bytes over the
+ * peak heap footprint, and the result of mm_check on the heap as
+ * the trace left it. The footprint is what mm_footprint reports:
+ * the memlib heap, the slab runs handed out so far and the mapped
+ * length of every live block with a mapping of its own.
+ *
+ * Build against the allocator and the lab's memlib:
+ *     gcc -O2 -pthread mm_replay.c mm.c memlib.c -o mm_replay
+ *
+ * Adding -DMM_PROFILE to both files also prints the allocator's
+ * latency histograms, over all repetitions, after each trace.
+ *
+ * Usage: mm_replay [-s] [-n reps] trace...
+ *     -s       also replay every trace against the system malloc
+ *     -n reps  repetitions per trace, the fastest one is reported
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "mm.h"
+#include "mm_stats.h"
+#include "memlib.h"
+
+#define DEFAULT_REPS 3
+
+#ifdef MM_PROFILE
+/* Exported by mm.c in profiling builds */
+void mm_profile_reset(void);
+void mm_profile_dump(FILE * out);
+#endif
+
+typedef struct op {
+    char    type;               /* 'a', 'f' or 'r' */
+    size_t  id;
+    size_t  size;
+} op_t;
+
+typedef struct trace {
+    op_t *  ops;
+    size_t  num_ops;
+    size_t  num_ids;
+} trace_t;
+
+typedef struct allocator {
+    const char * name;
+    bool         is_mm;         /* utilization and mm_check only apply to mm */
+    void *       (*malloc_fn)(size_t size);
+    void         (*free_fn)(void * ptr);
+    void *       (*realloc_fn)(void * ptr, size_t size);
+} allocator_t;
+
+typedef struct result {
+    double  seconds;
+    size_t  peak_live;
+    size_t  peak_footprint;
+    bool    failed;             /* an allocation of nonzero size failed or was misaligned */
+    int     check;              /* mm_check after the trace, 1 if consistent */
+} result_t;
+
+static const allocator_t mm_allocator = { "mm", true, mm_malloc, mm_free, mm_realloc };
+static const allocator_t libc_allocator = { "libc", false, malloc, free, realloc };
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**********************************************************
+ * read_trace
+ * Parse a trace file. The classic header is skipped when
+ * present, ids may be sparse.
+ *
+ * @return bool - false if the file cannot be read or holds
+ *                a malformed request
+ **********************************************************/
+static bool read_trace(const char * path, trace_t * trace)
+{
+    FILE * file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    size_t capacity = 1024;
+    char line[256];
+    size_t line_no = 0;
+
+    trace->ops = malloc(capacity * sizeof(op_t));
+    trace->num_ops = 0;
+    trace->num_ids = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char * cursor = line;
+        line_no++;
+
+        while (isspace((unsigned char)*cursor))
+            cursor++;
+        // Blank lines and the numeric header lines carry no requests
+        if (*cursor == '\0' || isdigit((unsigned char)*cursor))
+            continue;
+
+        op_t op = { *cursor, 0, 0 };
+        int fields = sscanf(cursor + 1, "%zu %zu", &op.id, &op.size);
+        if ((op.type == 'f' && fields < 1) ||
+            ((op.type == 'a' || op.type == 'r') && fields < 2) ||
+            (op.type != 'a' && op.type != 'f' && op.type != 'r'))
+        {
+            fprintf(stderr, "%s:%zu: malformed request\n", path, line_no);
+            fclose(file);
+            free(trace->ops);
+            return false;
+        }
+
+        if (trace->num_ops == capacity)
+        {
+            capacity *= 2;
+            trace->ops = realloc(trace->ops, capacity * sizeof(op_t));
+        }
+        trace->ops[trace->num_ops++] = op;
+        if (op.id >= trace->num_ids)
+        {
+            trace->num_ids = op.id + 1;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+/**********************************************************
+ * replay
+ * Run a trace once against an allocator, starting from a
+ * fresh heap in the case of mm. Blocks still live at the
+ * end of the trace are freed after the timed section.
+ *
+ * @return result_t - timing, footprint and check results
+ **********************************************************/
+static result_t replay(const trace_t * trace, const allocator_t * alloc)
+{
+    result_t result = { 0, 0, 0, false, 1 };
+    void ** blocks = calloc(trace->num_ids, sizeof(void *));
+    size_t * sizes = calloc(trace->num_ids, sizeof(size_t));
+    size_t live = 0;
+    size_t itr;
+
+    if (alloc->is_mm)
+    {
+        mem_reset_brk();
+        if (mm_init() != 0)
+        {
+            result.failed = true;
+            goto out;
+        }
+    }
+
+    double start = now_ns();
+    for (itr = 0; itr < trace->num_ops; itr++)
+    {
+        const op_t * op = &trace->ops[itr];
+        void * ptr;
+
+        switch (op->type)
+        {
+        case 'a':
+            ptr = alloc->malloc_fn(op->size);
+            break;
+        case 'r':
+            ptr = alloc->realloc_fn(blocks[op->id], op->size);
+            break;
+        default:
+            alloc->free_fn(blocks[op->id]);
+            ptr = NULL;
+            break;
+        }
+
+        // Requests of zero bytes may get NULL, and a realloc to zero bytes then freed the block
+        if (op->type != 'f' && ((ptr == NULL && op->size != 0) || ((uintptr_t)ptr & 15)))
+        {
+            result.failed = true;
+            break;
+        }
+
+        // Footprint bookkeeping is only needed for utilization, which libc does not get
+        if (alloc->is_mm)
+        {
+            live = live - sizes[op->id] + op->size;
+            result.peak_live = live > result.peak_live ? live : result.peak_live;
+            size_t footprint = mm_footprint();
+            result.peak_footprint = footprint > result.peak_footprint ? footprint : result.peak_footprint;
+        }
+        blocks[op->id] = ptr;
+        sizes[op->id] = op->type == 'f' ? 0 : op->size;
+    }
+    result.seconds = (now_ns() - start) / 1e9;
+
+    if (alloc->is_mm && !result.failed)
+    {
+        result.check = mm_check();
+    }
+
+    for (itr = 0; itr < trace->num_ids; itr++)
+    {
+        if (blocks[itr] != NULL)
+            alloc->free_fn(blocks[itr]);
+    }
+
+out:
+    free(blocks);
+    free(sizes);
+    return result;
+}
+
+/**********************************************************
+ * report
+ * Replay a trace reps times and print one result row.
+ *
+ * @return bool - false if the trace failed or mm_check did
+ **********************************************************/
+static bool report(const char * path, const trace_t * trace, const allocator_t * alloc, int reps)
+{
+    result_t best = replay(trace, alloc);
+    int rep;
+
+    for (rep = 1; rep < reps && !best.failed; rep++)
+    {
+        result_t result = replay(trace, alloc);
+        if (result.failed || result.seconds < best.seconds)
+            best = result;
+    }
+
+    if (best.failed)
+    {
+        printf("%-24s %-5s %10zu %12s\n", path, alloc->name, trace->num_ops, "failed");
+        return false;
+    }
+
+    double kops = best.seconds > 0 ? trace->num_ops / best.seconds / 1e3 : 0;
+    if (alloc->is_mm)
+    {
+        double util = best.peak_footprint ? 100.0 * best.peak_live / best.peak_footprint : 100.0;
+        printf("%-24s %-5s %10zu %12.0f %7.1f%% %8s\n", path, alloc->name, trace->num_ops, kops, util,
+               best.check ? "ok" : "FAILED");
+    }
+    else
+    {
+        printf("%-24s %-5s %10zu %12.0f %8s %8s\n", path, alloc->name, trace->num_ops, kops, "-", "-");
+    }
+    return best.check;
+}
+
+int main(int argc, char **argv)
+{
+    bool compare = false;
+    int reps = DEFAULT_REPS;
+    int opt;
+    int status = 0;
+
+    while ((opt = getopt(argc, argv, "sn:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            compare = true;
+            break;
+        case 'n':
+            reps = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s] [-n reps] trace...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind == argc)
+    {
+        fprintf(stderr, "usage: %s [-s] [-n reps] trace...\n", argv[0]);
+        return 2;
+    }
+
+    mem_init();
+
+    printf("%-24s %-5s %10s %12s %8s %8s\n", "trace", "alloc", "ops", "Kops/s", "util", "mm_check");
+    for (; optind < argc; optind++)
+    {
+        trace_t trace;
+        if (!read_trace(argv[optind], &trace))
+        {
+            status = 1;
+            continue;
+        }
+
+#ifdef MM_PROFILE
+        mm_profile_reset();
+#endif
+        if (!report(argv[optind], &trace, &mm_allocator, reps))
+            status = 1;
+#ifdef MM_PROFILE
+        mm_profile_dump(stdout);
+#endif
+        if (compare)
+            report(argv[optind], &trace, &libc_allocator, reps);
+
+        free(trace.ops);
+    }
+
+    return status;
+}
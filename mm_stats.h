@@ -0,0 +1,45 @@
+/* Runtime statistics of the allocator.
+ *
+ * mm_stats takes a snapshot of the counters the allocator keeps for
+ * every arena, summed over all arenas. It can be called from any
+ * thread at any time. The counters are read without stopping the
+ * allocating threads, so a snapshot taken under load is not atomic
+ * as a whole; each counter on its own is consistent.
+ */
+
+#ifndef MM_STATS_H
+#define MM_STATS_H
+
+#include <stddef.h>
+
+/* Counters of one size class of the segregated list */
+typedef struct mm_bin_stats {
+    size_t  max_size;           /* largest block size of the class, 0 for the unbounded last one */
+    size_t  free_blocks;        /* free blocks currently in the class */
+    size_t  free_bytes;         /* bytes in those blocks */
+    size_t  allocs;             /* allocations served from a block of the class */
+} mm_bin_stats_t;
+
+typedef struct mm_stats {
+    size_t  free_bytes;         /* free bytes in the segregated lists and top chunks */
+    size_t  largest_free;       /* largest free block, top chunks included */
+    double  fragmentation;      /* external fragmentation, 1 - largest_free / free_bytes */
+    size_t  top_bytes;          /* free bytes in top chunks */
+    size_t  top_allocs;         /* allocations carved from a top chunk */
+    size_t  splits;             /* free blocks split to serve or shrink an allocation */
+    size_t  coalesces[4];       /* frees by coalesce case: no neighbour, next, previous, both free */
+    size_t  extend_calls;       /* heap extensions */
+    size_t  extend_bytes;       /* bytes added by heap extensions */
+    size_t  mmap_blocks;        /* live blocks with a mapping of their own */
+    size_t  mmap_bytes;         /* bytes mapped for them */
+} mm_stats_t;
+
+/* Fill stats and the first nbins entries of bins, which may be NULL.
+ * Returns the number of size classes the allocator has. */
+size_t mm_stats(mm_stats_t * stats, mm_bin_stats_t * bins, size_t nbins);
+
+/* Bytes the allocator holds: arena heaps, slab runs handed out and
+ * live mappings. Cheap enough to call after every request. */
+size_t mm_footprint(void);
+
+#endif
@@ -0,0 +1,252 @@
+/* dTLB benchmark for the HUGE_PAGES mode of the allocator.
+ *
+ * Allocates a working set far larger than the reach of the data
+ * TLB with 4 KiB pages, links it into one random cycle and chases
+ * the cycle, so nearly every access lands on another page and the
+ * run is bound by TLB misses unless the memory is backed by huge
+ * pages. Each phase reports the mean latency of one access and the
+ * AnonHugePages of the process once the working set is in place.
+ *
+ *     nodes   small blocks of random sizes, from slabs and the heap
+ *     arrays  a few large blocks with their own mappings, visited
+ *             one cell every CELL_STRIDE bytes
+ *
+ * The mode is chosen when the allocator is compiled, so build the
+ * benchmark twice and compare the two:
+ *     gcc -O2 -pthread mm_tlb_bench.c mm.c memlib.c -o mm_tlb_bench
+ *     gcc -O2 -pthread -DHUGE_PAGES=1 mm_tlb_bench.c mm.c memlib.c -o mm_tlb_bench_huge
+ *
+ * Transparent huge pages must be enabled in "madvise" or "always"
+ * mode, see /sys/kernel/mm/transparent_hugepage/enabled, and the
+ * memlib heap must hold the working set of the nodes phase.
+ *
+ * Usage: mm_tlb_bench [working set MiB] [accesses]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define DEFAULT_WORKING_SET 16              /* MiB */
+#define DEFAULT_ACCESSES    10000000
+#define NODE_MAX_SIZE       256             /* nodes are 16 to NODE_MAX_SIZE bytes */
+#define ARRAYS              4               /* large blocks of the arrays phase */
+#define CELL_STRIDE         256             /* bytes between the cells of an array */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/**********************************************************
+ * next_random
+ * Draw from a xorshift stream.
+ **********************************************************/
+static uint64_t next_random(void)
+{
+    uint64_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rng_state = x;
+    return x;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**********************************************************
+ * huge_kb
+ * Read the anonymous memory backed by huge pages from
+ * /proc/self/smaps_rollup.
+ *
+ * @return long - kilobytes, or -1 if the kernel does not
+ *                report it
+ **********************************************************/
+static long huge_kb(void)
+{
+    FILE * file = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    long kb = -1;
+
+    if (file == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+        {
+            break;
+        }
+    }
+    fclose(file);
+    return kb;
+}
+
+/**********************************************************
+ * chase
+ * Link the cells into one cycle in random order, through
+ * their first word, and follow it for the given number of
+ * accesses. Each load depends on the one before, so the
+ * latency of every TLB miss is paid in full.
+ *
+ * @return double mean nanoseconds per access
+ **********************************************************/
+static double chase(void ** cells, size_t ncells, long accesses)
+{
+    size_t itr;
+    long step;
+
+    for (itr = ncells - 1; itr > 0; itr--)
+    {
+        size_t other = next_random() % (itr + 1);
+        void * cell = cells[itr];
+        cells[itr] = cells[other];
+        cells[other] = cell;
+    }
+    for (itr = 0; itr < ncells; itr++)
+    {
+        *(void **)cells[itr] = cells[(itr + 1) % ncells];
+    }
+
+    void ** cursor = cells[0];
+    double start = now_ns();
+    for (step = 0; step < accesses; step++)
+    {
+        cursor = *cursor;
+    }
+    double elapsed = now_ns() - start;
+
+    // Keep the chase from being optimized away
+    if (cursor == NULL)
+    {
+        printf("unreachable\n");
+    }
+    return elapsed / accesses;
+}
+
+/**********************************************************
+ * run_nodes
+ * Chase through small blocks filling the working set.
+ *
+ * @return double mean nanoseconds per access, or a negative
+ *                value if the heap ran out of memory
+ **********************************************************/
+static double run_nodes(size_t working_set, long accesses, long * kb)
+{
+    size_t capacity = working_set / 16;
+    void ** cells = malloc(capacity * sizeof(void *));
+    size_t ncells = 0;
+    size_t bytes = 0;
+    double ns = -1;
+
+    while (bytes < working_set && ncells < capacity)
+    {
+        size_t size = 16 + next_random() % (NODE_MAX_SIZE - 15);
+        if ((cells[ncells] = mm_malloc(size)) == NULL)
+        {
+            goto out;
+        }
+        ncells++;
+        bytes += size;
+    }
+
+    *kb = huge_kb();
+    ns = chase(cells, ncells, accesses);
+
+out:
+    while (ncells > 0)
+    {
+        mm_free(cells[--ncells]);
+    }
+    free(cells);
+    return ns;
+}
+
+/**********************************************************
+ * run_arrays
+ * Chase through the cells of a few large blocks.
+ *
+ * @return double mean nanoseconds per access, or a negative
+ *                value if the allocation failed
+ **********************************************************/
+static double run_arrays(size_t working_set, long accesses, long * kb)
+{
+    size_t array_size = working_set / ARRAYS;
+    size_t per_array = array_size / CELL_STRIDE;
+    void ** cells = malloc(ARRAYS * per_array * sizeof(void *));
+    char * arrays[ARRAYS] = { NULL };
+    size_t itr, cell;
+    double ns = -1;
+
+    for (itr = 0; itr < ARRAYS; itr++)
+    {
+        if ((arrays[itr] = mm_malloc(array_size)) == NULL)
+        {
+            goto out;
+        }
+        memset(arrays[itr], 0, array_size);
+        for (cell = 0; cell < per_array; cell++)
+        {
+            cells[itr * per_array + cell] = arrays[itr] + cell * CELL_STRIDE;
+        }
+    }
+
+    *kb = huge_kb();
+    ns = chase(cells, ARRAYS * per_array, accesses);
+
+out:
+    for (itr = 0; itr < ARRAYS; itr++)
+    {
+        mm_free(arrays[itr]);
+    }
+    free(cells);
+    return ns;
+}
+
+int main(int argc, char **argv)
+{
+    size_t working_set = (size_t)(argc > 1 ? atol(argv[1]) : DEFAULT_WORKING_SET) << 20;
+    long accesses = argc > 2 ? atol(argv[2]) : DEFAULT_ACCESSES;
+    static const char * names[] = { "nodes", "arrays" };
+    static double (* const phases[])(size_t, long, long *) = { run_nodes, run_arrays };
+    size_t itr;
+
+    if (working_set == 0 || accesses <= 0)
+    {
+        fprintf(stderr, "usage: %s [working set MiB] [accesses]\n", argv[0]);
+        return 2;
+    }
+
+    mem_init();
+
+    printf("%-8s %12s %16s\n", "phase", "ns/access", "AnonHugePages kB");
+    for (itr = 0; itr < sizeof(phases) / sizeof(phases[0]); itr++)
+    {
+        long kb = -1;
+
+        mem_reset_brk();
+        if (mm_init() != 0)
+        {
+            printf("%-8s %12s\n", names[itr], "out of memory");
+            continue;
+        }
+
+        double ns = phases[itr](working_set, accesses, &kb);
+        if (ns < 0)
+        {
+            printf("%-8s %12s\n", names[itr], "out of memory");
+            continue;
+        }
+        printf("%-8s %12.1f %16ld\n", names[itr], ns, kb);
+    }
+
+    return 0;
+}